@@ -0,0 +1,109 @@
+// binary_log.{h,cpp}
+// -------------------------------------
+// Fixed-size binary representation of gallery log entries.
+//
+// responsibilities:
+// build and check the binary file header
+// pack validated entries into fixed-size records
+// unpack records and re-validate them with the text log rules
+// pack and unpack checkpoint records (version 3)
+
+#include "binary_log.h"
+#include "gallery_state.h"
+#include <cstring>         // memcpy, memset
+#include <iterator>        // std::size
+#include <string>
+
+void initBinaryHeader(BinaryLogHeader& h) {
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, BINARY_LOG_MAGIC, sizeof(h.magic));
+    h.version = BINARY_LOG_VERSION;
+    h.recordSize = sizeof(BinaryLogRecord);
+}
+
+bool checkBinaryHeader(const BinaryLogHeader& h) {
+    return std::memcmp(h.magic, BINARY_LOG_MAGIC, sizeof(h.magic)) == 0 &&
+           h.version >= 1 && h.version <= BINARY_LOG_VERSION &&
+           h.recordSize == sizeof(BinaryLogRecord);
+}
+
+void packRecord(const LogEntry& e, BinaryLogRecord& out) {
+    std::memset(&out, 0, sizeof(out));
+    out.timestamp = e.timestamp;
+    out.action    = static_cast<uint8_t>(e.action);
+    out.room      = static_cast<uint8_t>(e.room);
+    out.actorLen  = static_cast<uint8_t>(e.actorId.size());
+    out.personLen = static_cast<uint8_t>(e.personId.size());
+    std::memcpy(out.actorId, e.actorId.data(), e.actorId.size());
+    std::memcpy(out.personId, e.personId.data(), e.personId.size());
+}
+
+bool unpackRecord(const BinaryLogRecord& rec, LogEntry& out, uint32_t version) {
+    const int64_t scale = version == 1 ? TIMESTAMP_UNITS_PER_SECOND : 1;
+
+    // Reject anything that cannot even be turned back into text.
+    if (rec.timestamp < 0 || rec.timestamp > MAX_TIMESTAMP / scale) return false;
+    if (rec.action >= std::size(ACTION_NAMES)) return false;
+    if (rec.room >= std::size(ROOM_NAMES)) return false;
+    if (rec.actorLen > BINARY_ID_CAPACITY || rec.personLen > BINARY_ID_CAPACITY) return false;
+
+    LogEntry e;
+    e.timestamp = rec.timestamp * scale;
+    e.actorId.assign(std::string_view(rec.actorId, rec.actorLen));
+    e.personId.assign(std::string_view(rec.personId, rec.personLen));
+    e.action = static_cast<Action>(rec.action);
+    e.room   = static_cast<Room>(rec.room);
+
+    char line[MAX_LOG_LINE_CHARS];
+    return parseLogLine(std::string_view(line, formatLogEntry(e, line) - line), out);
+}
+
+bool packCheckpointLine(std::string_view line, BinaryLogRecord& out) {
+    int64_t timestamp;
+    size_t count;
+    GalleryId personId;
+    Room room;
+    std::memset(&out, 0, sizeof(out));
+    if (parseCheckpointHeader(line, timestamp, count)) {
+        if (count > UINT32_MAX) return false;
+        out.timestamp = timestamp;
+        out.action    = BINARY_CHECKPOINT;
+        out.count     = static_cast<uint32_t>(count);
+        return true;
+    }
+    if (parseCheckpointState(line, personId, room)) {
+        out.action    = BINARY_STATE;
+        out.room      = static_cast<uint8_t>(room);
+        out.personLen = static_cast<uint8_t>(personId.size());
+        std::memcpy(out.personId, personId.data(), personId.size());
+        return true;
+    }
+    return false;
+}
+
+bool unpackCheckpointRecord(const BinaryLogRecord& rec, std::string& out, uint32_t version) {
+    if (version < 3) return false;
+
+    std::string line;
+    if (rec.action == BINARY_CHECKPOINT) {
+        if (rec.timestamp < 0 || rec.timestamp > MAX_TIMESTAMP) return false;
+        appendCheckpointHeader(line, rec.timestamp, rec.count);
+    } else if (rec.action == BINARY_STATE) {
+        if (rec.room >= std::size(ROOM_NAMES) || rec.personLen > BINARY_ID_CAPACITY) return false;
+        appendCheckpointState(line, std::string_view(rec.personId, rec.personLen),
+                              static_cast<Room>(rec.room));
+    } else {
+        return false;
+    }
+
+    const std::string_view text(line.data(), line.size() - 1); // without '\n'
+    int64_t timestamp;
+    size_t count;
+    GalleryId personId;
+    Room room;
+    if (!parseCheckpointHeader(text, timestamp, count) && !parseCheckpointState(text, personId, room)) {
+        return false;
+    }
+    out += line;
+    return true;
+}
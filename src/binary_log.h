@@ -0,0 +1,69 @@
+// binary_log.{h,cpp}
+// -------------------------------------
+// Fixed-size binary representation of gallery log entries.
+// Used by logconvert to migrate between the text log and binary files.
+//
+// file layout: one 64-byte header followed by 80-byte records.
+// All integers are stored little-endian. Version 1 files stored
+// timestamps in seconds; they are still read (and scaled). Version 3
+// adds checkpoint records (gallery_state.h), one per text line, marked
+// by an action code past the real actions:
+//   BINARY_CHECKPOINT: timestamp, count = people inside
+//   BINARY_STATE:      personId, room
+
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include "security_utils.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+inline constexpr char     BINARY_LOG_MAGIC[8]   = {'G','L','O','G','B','I','N','1'};
+inline constexpr uint32_t BINARY_LOG_VERSION    = 3;
+inline constexpr size_t   BINARY_ID_CAPACITY    = 32; // matches the ID length limit
+inline constexpr uint8_t  BINARY_CHECKPOINT     = 0xC0; // action of a #checkpoint record
+inline constexpr uint8_t  BINARY_STATE          = 0xC1; // action of a #state record
+
+struct BinaryLogHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint8_t  reserved[48];
+};
+
+struct BinaryLogRecord {
+    int64_t timestamp;                   // microseconds since the epoch (v1: seconds)
+    uint8_t action;                      // Action code
+    uint8_t room;                        // Room code
+    uint8_t actorLen;                    // bytes used in actorId
+    uint8_t personLen;                   // bytes used in personId
+    char    actorId[BINARY_ID_CAPACITY];
+    char    personId[BINARY_ID_CAPACITY];
+    uint32_t count;                      // BINARY_CHECKPOINT only (v1/v2: reserved, 0)
+};
+
+static_assert(sizeof(BinaryLogHeader) == 64, "binary header layout changed");
+static_assert(sizeof(BinaryLogRecord) == 80, "binary record layout changed");
+
+void initBinaryHeader(BinaryLogHeader& h);
+// Accepts the current and older versions; pass h.version to unpackRecord.
+bool checkBinaryHeader(const BinaryLogHeader& h);
+
+// Entry must already be validated (e.g. by parseLogLine).
+void packRecord(const LogEntry& e, BinaryLogRecord& out);
+
+// Rebuilds the text line and runs it through parseLogLine, so binary input
+// passes exactly the same validation as the text log.
+bool unpackRecord(const BinaryLogRecord& rec, LogEntry& out, uint32_t version = BINARY_LOG_VERSION);
+
+// Checkpoint lines: false if line is not a valid #checkpoint/#state line.
+bool packCheckpointLine(std::string_view line, BinaryLogRecord& out);
+
+// Appends the checkpoint line rec stands for ('\n' included), validated
+// with the same parser as the text log; false if rec is not one.
+bool unpackCheckpointRecord(const BinaryLogRecord& rec, std::string& out,
+                            uint32_t version = BINARY_LOG_VERSION);
+
+#endif // BINARY_LOG_H
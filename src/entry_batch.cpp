@@ -0,0 +1,27 @@
+// entry_batch.{h,cpp}
+// -------------------------------------
+// Block storage for parsed log entries.
+//
+// responsibilities:
+// carve entry blocks out of the batch's monotonic arena
+// copy entries out a block at a time
+
+#include "entry_batch.h"
+#include <algorithm>       // min
+#include <type_traits>
+
+static_assert(std::is_trivially_destructible_v<LogEntry>,
+              "the arena releases blocks without destroying the entries in them");
+
+void EntryBatch::addBlock() {
+    void* block = arena_.allocate(ENTRY_BLOCK * sizeof(LogEntry), alignof(LogEntry));
+    blocks_.push_back(static_cast<LogEntry*>(block));
+}
+
+void EntryBatch::appendTo(std::vector<LogEntry>& out) const {
+    out.reserve(out.size() + size_);
+    for (size_t done = 0, b = 0; done < size_; done += ENTRY_BLOCK, ++b) {
+        const size_t n = std::min(ENTRY_BLOCK, size_ - done);
+        out.insert(out.end(), blocks_[b], blocks_[b] + n);
+    }
+}
@@ -0,0 +1,53 @@
+// entry_batch.{h,cpp}
+// -------------------------------------
+// Append-only batch of parsed log entries, filled by one readSegment
+// parse chunk.
+//
+// Entries are stored in fixed blocks of ENTRY_BLOCK entries carved from a
+// monotonic arena (std::pmr::monotonic_buffer_resource). A filled slot
+// never moves, so filling a batch costs one arena allocation per block
+// instead of a vector's reallocate-and-copy at every doubling. LogEntry
+// is trivially copyable, so copying a batch out is one memcpy per block.
+// That copy into the segment's entry list is the only one an entry sees
+// after parsing; the batch itself lives only as long as its chunk and
+// its memory is returned when it is destroyed. A batch belongs to one
+// thread at a time.
+
+#ifndef ENTRY_BATCH_H
+#define ENTRY_BATCH_H
+
+#include "security_utils.h"
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+inline constexpr size_t ENTRY_BLOCK = 4096; // entries per block (320 KiB)
+
+class EntryBatch {
+public:
+    EntryBatch() = default;
+    EntryBatch(const EntryBatch&) = delete;
+    EntryBatch& operator=(const EntryBatch&) = delete;
+
+    void push_back(const LogEntry& e) {
+        if (size_ == blocks_.size() * ENTRY_BLOCK) addBlock();
+        ::new (blocks_[size_ / ENTRY_BLOCK] + size_ % ENTRY_BLOCK) LogEntry(e);
+        ++size_;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Appends every entry to out, in order.
+    void appendTo(std::vector<LogEntry>& out) const;
+
+private:
+    void addBlock();
+
+    std::pmr::monotonic_buffer_resource arena_;
+    std::vector<LogEntry*> blocks_;
+    size_t size_ = 0;
+};
+
+#endif // ENTRY_BATCH_H
@@ -0,0 +1,253 @@
+// event_ring.{h,cpp}
+// -------------------------------------
+// Shared-memory MPSC ring buffer for local event ingestion.
+//
+// responsibilities:
+// create / attach the /dev/shm segment (0600); one consumer at a time
+// lock-free enqueue for any number of producer processes
+// dequeue for the single logingest consumer; skip slots whose producer
+// died between claiming and publishing them
+// convert between RingEvent slots and validated LogEntry values,
+// rechecking the producer's token digest against the store on the way out
+// EventProducer: authenticate a collector's token and enqueue for it
+
+#include "event_ring.h"
+#include <cerrno>
+#include <csignal>         // kill
+#include <cstring>         // memcpy, memset
+#include <iterator>        // std::size
+#include <new>             // placement new
+#include <sys/mman.h>      // shm_open, mmap
+#include <sys/stat.h>      // fstat
+#include <fcntl.h>         // O_* flags
+#include <unistd.h>        // ftruncate, close, getpid
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<pid_t>::is_always_lock_free,
+              "ring positions must be lock-free to live in shared memory");
+static_assert((EVENT_RING_SLOTS & (EVENT_RING_SLOTS - 1)) == 0, "slot count must be a power of two");
+
+static constexpr uint64_t RING_MAGIC = 0x474c4f4752494e33ull; // "GLOGRIN3": token digests, owners
+
+struct alignas(64) RingSlot {
+    std::atomic<uint64_t> seq;
+    std::atomic<pid_t> owner; // producer that claimed the slot (0 = none recorded)
+    RingEvent ev;
+};
+
+// Layout of the shared segment. Positions live on their own cache lines
+// so producers and the consumer do not false-share.
+struct EventRing::Shared {
+    std::atomic<uint64_t> magic;  // set last, once the segment is initialized
+    uint32_t slotCount;
+    uint32_t slotSize;
+    alignas(64) std::atomic<uint64_t> enqueuePos;
+    alignas(64) std::atomic<uint64_t> dequeuePos;
+    RingSlot slots[EVENT_RING_SLOTS];
+};
+
+bool makeRingEvent(const UserTokenInfo& user, std::string_view personId,
+                   Action action, Room room, RingEvent& ev) {
+    const std::string_view actorId = user.actorId;
+    if (!validatePersonId(actorId) || !validatePersonId(personId)) return false; // same ID rules
+
+    std::memset(&ev, 0, sizeof(ev));
+    ev.timestamp = getCurrentTimestamp();
+    ev.action    = static_cast<uint8_t>(action);
+    ev.room      = static_cast<uint8_t>(room);
+    ev.actorLen  = static_cast<uint8_t>(actorId.size());
+    ev.personLen = static_cast<uint8_t>(personId.size());
+    std::memcpy(ev.actorId, actorId.data(), actorId.size());
+    std::memcpy(ev.personId, personId.data(), personId.size());
+    ev.tokenHash = user.tokenHash;
+    return true;
+}
+
+std::string ringEventToEntry(const RingEvent& ev, const TokenStore& store, LogEntry& out) {
+    const std::string malformed = "malformed ring slot";
+    if (ev.timestamp < 0 || ev.timestamp > MAX_TIMESTAMP) return malformed;
+    if (ev.action >= std::size(ACTION_NAMES) || ev.room >= std::size(ROOM_NAMES)) return malformed;
+    if (ev.actorLen > RING_ID_CAPACITY || ev.personLen > RING_ID_CAPACITY) return malformed;
+
+    LogEntry e;
+    e.timestamp = ev.timestamp;
+    e.actorId.assign(std::string_view(ev.actorId, ev.actorLen));
+    e.personId.assign(std::string_view(ev.personId, ev.personLen));
+    e.action = static_cast<Action>(ev.action);
+    e.room   = static_cast<Room>(ev.room);
+
+    // same rules as every line read back from the log
+    char line[MAX_LOG_LINE_CHARS];
+    if (!parseLogLine(std::string_view(line, formatLogEntry(e, line) - line), out)) return malformed;
+
+    // The producer's token must still be valid and belong to the actor.
+    const UserTokenInfo* user = store.find(ev.tokenHash);
+    if (!user || !permissionAllows(user->permission, Operation::Append) || user->actorId != out.actorId) {
+        return "producer token unknown, revoked or not allowed to append as '" + out.actorId.str() + "'";
+    }
+    return std::string();
+}
+
+EventRing::~EventRing() {
+    if (shared_) ::munmap(shared_, sizeof(Shared));
+    if (lockFd_ >= 0) ::close(lockFd_); // releases the consumer lock
+}
+
+bool EventRing::map(int fd, bool init) {
+    void* p = ::mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    shared_ = static_cast<Shared*>(p);
+
+    if (init) {
+        // A fresh or half-initialized segment: nobody attaches until magic is set.
+        new (&shared_->enqueuePos) std::atomic<uint64_t>(0);
+        new (&shared_->dequeuePos) std::atomic<uint64_t>(0);
+        for (uint32_t i = 0; i < EVENT_RING_SLOTS; ++i) {
+            new (&shared_->slots[i].seq) std::atomic<uint64_t>(i);
+            new (&shared_->slots[i].owner) std::atomic<pid_t>(0);
+        }
+        shared_->slotCount = EVENT_RING_SLOTS;
+        shared_->slotSize = sizeof(RingSlot);
+        shared_->magic.store(RING_MAGIC, std::memory_order_release);
+        return true;
+    }
+
+    if (shared_->magic.load(std::memory_order_acquire) != RING_MAGIC ||
+        shared_->slotCount != EVENT_RING_SLOTS || shared_->slotSize != sizeof(RingSlot)) {
+        ::munmap(shared_, sizeof(Shared));
+        shared_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool EventRing::create(std::string* error, const std::string& name) {
+    auto fail = [&](const char* msg) {
+        if (error) *error = msg;
+        return false;
+    };
+
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return fail("failed to create event ring");
+
+    // The dequeue side is single-consumer: hold an exclusive OFD lock on
+    // the segment for as long as this EventRing lives (never wait for it).
+    struct flock fl{};
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    if (::fcntl(fd, F_OFD_SETLK, &fl) != 0) {
+        const bool held = errno == EAGAIN || errno == EACCES;
+        ::close(fd);
+        return fail(held ? "event ring already has a consumer (is logingest running?)"
+                         : "failed to lock event ring");
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return fail("failed to create event ring");
+    }
+
+    // Reattach to a valid existing ring, otherwise (re)initialize it.
+    bool mapped = st.st_size == static_cast<off_t>(sizeof(Shared)) && map(::dup(fd), false);
+    if (!mapped && ::ftruncate(fd, sizeof(Shared)) == 0) mapped = map(::dup(fd), true);
+    if (!mapped) {
+        ::close(fd);
+        return fail("failed to create event ring");
+    }
+    lockFd_ = fd;
+    return true;
+}
+
+bool EventRing::attach(const std::string& name) {
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) return false;
+    return map(fd, false);
+}
+
+bool EventRing::tryEnqueue(const RingEvent& ev, pid_t producer) {
+    const uint64_t mask = EVENT_RING_SLOTS - 1;
+    uint64_t pos = shared_->enqueuePos.load(std::memory_order_relaxed);
+
+    while (true) {
+        RingSlot& slot = shared_->slots[pos & mask];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+
+        if (diff == 0) {
+            // slot is free for this position: claim it
+            if (shared_->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.owner.store(producer, std::memory_order_relaxed); // see skipAbandoned
+                slot.ev = ev;
+                slot.seq.store(pos + 1, std::memory_order_release); // publish
+                return true;
+            }
+            // lost the race; pos now holds the current value
+        } else if (diff < 0) {
+            return false; // consumer has not freed this slot yet: full
+        } else {
+            pos = shared_->enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool EventRing::tryDequeue(RingEvent& ev) {
+    const uint64_t pos = shared_->dequeuePos.load(std::memory_order_relaxed);
+    RingSlot& slot = shared_->slots[pos & (EVENT_RING_SLOTS - 1)];
+
+    if (slot.seq.load(std::memory_order_acquire) != pos + 1) return false; // not published yet
+
+    ev = slot.ev;
+    std::memset(&slot.ev.tokenHash, 0, sizeof(slot.ev.tokenHash)); // do not leave digests behind
+    slot.owner.store(0, std::memory_order_relaxed);
+    slot.seq.store(pos + EVENT_RING_SLOTS, std::memory_order_release); // free for the next lap
+    shared_->dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+bool EventRing::skipAbandoned(pid_t& pid) {
+    const uint64_t pos = shared_->dequeuePos.load(std::memory_order_relaxed);
+    RingSlot& slot = shared_->slots[pos & (EVENT_RING_SLOTS - 1)];
+
+    // Free for this lap (seq == pos) yet already handed out: claimed and
+    // not published.
+    if (slot.seq.load(std::memory_order_acquire) != pos ||
+        shared_->enqueuePos.load(std::memory_order_relaxed) <= pos) {
+        return false;
+    }
+    const pid_t owner = slot.owner.load(std::memory_order_relaxed);
+    if (owner <= 0 || ::kill(owner, 0) == 0 || errno != ESRCH) return false; // alive, or unknown
+
+    // It may have published just before it died.
+    if (slot.seq.load(std::memory_order_acquire) != pos) return false;
+
+    slot.owner.store(0, std::memory_order_relaxed);
+    slot.seq.store(pos + EVENT_RING_SLOTS, std::memory_order_release);
+    shared_->dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    pid = owner;
+    return true;
+}
+
+std::unique_ptr<EventProducer> EventProducer::open(const std::string& token, std::string* error,
+                                                   const std::string& name) {
+    auto fail = [&](const char* msg) {
+        if (error) *error = msg;
+        return std::unique_ptr<EventProducer>();
+    };
+
+    const auto store = getTokenStore();
+    const UserTokenInfo* user = authenticateToken(token, Operation::Append, store);
+    if (!user) return fail("authentication failed");
+
+    std::unique_ptr<EventProducer> producer(new EventProducer());
+    producer->user_ = *user;
+    producer->pid_ = ::getpid(); // once: glibc does not cache it, and enqueue makes no syscalls
+    if (!producer->ring_.attach(name)) return fail("failed to attach to event ring (is logingest running?)");
+    return producer;
+}
+
+bool EventProducer::submit(std::string_view personId, Action action, Room room) {
+    RingEvent ev;
+    return makeRingEvent(user_, personId, action, room, ev) && ring_.tryEnqueue(ev, pid_);
+}
@@ -0,0 +1,132 @@
+// event_ring.{h,cpp}
+// -------------------------------------
+// Shared-memory multi-producer / single-consumer ring buffer for local
+// event ingestion.
+//
+// Collector processes open an EventProducer and enqueue events with a
+// single compare-and-swap plus a release store: no locks and no syscalls.
+// The logingest daemon is the only consumer; it validates events against
+// live state and appends them to the log in batches. create() takes an
+// exclusive OFD lock on the segment and holds it until the EventRing is
+// destroyed, so a second consumer is refused instead of racing the first
+// on the dequeue position.
+//
+// The segment is created 0600 under /dev/shm, so only the gallery log's
+// own user can attach; that is the ring's only access control.
+// EventProducer::open authenticates the collector's token
+// (Operation::Append) and stamps every event with that token's actorId
+// and digest. The consumer looks the digest up in the token store again
+// and drops events whose token is unknown, revoked since the producer
+// opened, lacks APPEND or belongs to another actor. The digest names the
+// token; it does not prove the producer holds it. It is the value stored
+// in the token store, so a process that can map the ring (which can also
+// read the store, and write the log directly) can stamp any actor's.
+//
+// Slot protocol (bounded MPMC queue by D. Vyukov, used with one consumer):
+// each slot carries a sequence number. A slot is free for position p when
+// seq == p, and holds a published event for p when seq == p + 1.
+//
+// A producer that dies between claiming a slot and publishing it would
+// stall the consumer at that slot for good. Each claim therefore records
+// the producer's pid (read once, when the EventProducer is opened; open a
+// new one after fork) right after the claim, and the consumer skips a
+// claimed slot whose producer no longer exists (skipAbandoned). A dead
+// producer cannot publish late, so skipping never races a write. Two
+// cases still wait: a producer killed in the few instructions between the
+// claim and recording its pid, and a dead producer's pid reused by a new
+// process (until that process exits); producers must share the
+// consumer's pid namespace.
+
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include "security_utils.h"
+#include "token_store.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+inline const std::string EVENT_RING_NAME = "/gallerylog-ring";
+inline constexpr uint32_t EVENT_RING_SLOTS = 4096; // power of two
+inline constexpr size_t   RING_ID_CAPACITY = 32;   // matches the ID length limit
+
+// One event as stored in a slot (plain data, no pointers).
+struct RingEvent {
+    int64_t timestamp;            // microseconds since the epoch, stamped at enqueue
+    uint8_t action;               // Action code
+    uint8_t room;                 // Room code
+    uint8_t actorLen;
+    uint8_t personLen;
+    char    actorId[RING_ID_CAPACITY];
+    char    personId[RING_ID_CAPACITY];
+    Digest  tokenHash;            // producer's token digest, rechecked for revocation
+};
+
+// Validates the fields and fills ev for an authenticated producer
+// (timestamp = now, actorId and tokenHash from user).
+bool makeRingEvent(const UserTokenInfo& user, std::string_view personId,
+                   Action action, Room room, RingEvent& ev);
+
+// Turns a dequeued event back into a LogEntry: re-validated (the segment
+// is writable by every producer) and its token digest checked against
+// store (still present, APPEND, same actor). Returns an empty string on
+// success, otherwise why it was rejected.
+std::string ringEventToEntry(const RingEvent& ev, const TokenStore& store, LogEntry& out);
+
+class EventRing {
+public:
+    EventRing() = default;
+    ~EventRing();
+    EventRing(const EventRing&) = delete;
+    EventRing& operator=(const EventRing&) = delete;
+
+    // consumer: create the segment, or reattach to an existing one so
+    // events queued across a daemon restart are not lost. Fails (error
+    // set) while another consumer holds the ring.
+    bool create(std::string* error = nullptr, const std::string& name = EVENT_RING_NAME);
+    // producer: attach to a segment created by the consumer
+    bool attach(const std::string& name = EVENT_RING_NAME);
+
+    // producer is the caller's pid, recorded in the claimed slot
+    bool tryEnqueue(const RingEvent& ev, pid_t producer); // false if the ring is full
+    bool tryDequeue(RingEvent& ev);       // single consumer only; false if empty
+
+    // Single consumer only: if the next slot was claimed by a producer
+    // that has since died without publishing, frees it and returns true
+    // (the event it was claimed for is lost; pid gets the producer).
+    bool skipAbandoned(pid_t& pid);
+
+private:
+    struct Shared;
+    bool map(int fd, bool init);
+
+    Shared* shared_ = nullptr;
+    int lockFd_ = -1; // consumer: holds the exclusive lock
+};
+
+// Producer entry point for collectors.
+class EventProducer {
+public:
+    // Authenticates token for Operation::Append and attaches to the ring
+    // (logingest must have created it). nullptr with error set otherwise.
+    static std::unique_ptr<EventProducer> open(const std::string& token, std::string* error = nullptr,
+                                               const std::string& name = EVENT_RING_NAME);
+
+    // Enqueues one event for personId, stamped with the authenticated
+    // actorId. False if personId is invalid or the ring is full.
+    bool submit(std::string_view personId, Action action, Room room);
+
+    const GalleryId& actorId() const { return user_.actorId; }
+
+private:
+    EventProducer() = default;
+
+    EventRing ring_;
+    UserTokenInfo user_;
+    pid_t pid_ = 0;
+};
+
+#endif // EVENT_RING_H
@@ -0,0 +1,112 @@
+// fixed_id.h
+// -------------------------------------
+// Fixed-capacity inline string for actor and person IDs.
+//
+// IDs are at most a few dozen bytes, so FixedId<N> keeps them in the
+// object itself: N bytes plus a length byte, no heap allocation, and
+// trivially copyable, so entries holding IDs can be copied with memcpy
+// into batches and files. Bytes past the length are always zero, which
+// makes equality a single fixed-size memcmp.
+//
+// hashId() is the hash the ID dictionary indexes with; FixedId::hash()
+// gives the same value for the same bytes.
+
+#ifndef FIXED_ID_H
+#define FIXED_ID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// IDs are short, so hash them a word at a time: fold each 8-byte word in
+// with a multiply and finish with a mix that spreads every byte over the
+// low bits. A partial last word is read as the 8 bytes ending the ID
+// (overlapping the previous word), so every load has a fixed size; only
+// IDs under 8 bytes are gathered byte by byte.
+inline uint32_t hashId(std::string_view id) {
+    constexpr uint64_t K = 0x9E3779B97F4A7C15ull;
+    const char* p = id.data();
+    const size_t n = id.size();
+    uint64_t h = n * K, w = 0;
+    if (n >= 8) {
+        for (size_t i = 0; i + 8 < n; i += 8) {
+            std::memcpy(&w, p + i, 8);
+            h = (h ^ w) * K;
+            h ^= h >> 32;
+        }
+        std::memcpy(&w, p + n - 8, 8);
+    } else {
+        for (size_t i = 0; i < n; ++i) w |= uint64_t{static_cast<unsigned char>(p[i])} << (8 * i);
+    }
+    h = (h ^ w) * K;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    return static_cast<uint32_t>(h);
+}
+
+template <size_t N>
+class FixedId {
+    static_assert(N > 0 && N < 256, "the length is stored in one byte");
+
+public:
+    FixedId() = default;
+    // s must fit; anything longer leaves the ID empty (see assign).
+    explicit FixedId(std::string_view s) { assign(s); }
+
+    // Copies s in. IDs are validated before they get here, so an ID that
+    // does not fit is an error: the ID is left empty and false returned,
+    // which every validator rejects.
+    bool assign(std::string_view s) {
+        std::memset(data_, 0, N);
+        if (s.size() > N) {
+            len_ = 0;
+            return false;
+        }
+        std::memcpy(data_, s.data(), s.size());
+        len_ = static_cast<uint8_t>(s.size());
+        return true;
+    }
+    void clear() { *this = FixedId(); }
+
+    static constexpr size_t capacity() { return N; }
+    size_t size() const { return len_; }
+    bool empty() const { return len_ == 0; }
+    const char* data() const { return data_; }
+
+    std::string_view view() const { return std::string_view(data_, len_); }
+    operator std::string_view() const { return view(); }
+    std::string str() const { return std::string(data_, len_); }
+
+    uint32_t hash() const { return hashId(view()); }
+
+    friend bool operator==(const FixedId& a, const FixedId& b) {
+        return std::memcmp(&a, &b, sizeof(FixedId)) == 0; // zero tails compare equal
+    }
+    friend bool operator!=(const FixedId& a, const FixedId& b) { return !(a == b); }
+    friend bool operator==(const FixedId& a, std::string_view b) { return a.view() == b; }
+    friend bool operator!=(const FixedId& a, std::string_view b) { return a.view() != b; }
+
+    friend std::ostream& operator<<(std::ostream& os, const FixedId& id) { return os << id.view(); }
+
+private:
+    uint8_t len_ = 0;
+    char data_[N] = {};
+};
+
+static_assert(sizeof(FixedId<32>) == 33, "FixedId has no padding to compare");
+static_assert(std::is_trivially_copyable_v<FixedId<32>>, "FixedId must stay memcpy-able");
+
+namespace std {
+template <size_t N>
+struct hash<FixedId<N>> {
+    size_t operator()(const FixedId<N>& id) const { return id.hash(); }
+};
+} // namespace std
+
+#endif // FIXED_ID_H
@@ -0,0 +1,315 @@
+// gallery_log.{h,cpp}
+// -------------------------------------
+// Embeddable, thread-safe API to the gallery log (libgallerylog).
+//
+// responsibilities:
+// authenticate the token up front, and check before every batch that the
+// current token store still maps it to the same actor and permission
+// lock-free multi-producer enqueue of validated events
+// one writer thread: drain in batches, route to shards, rule-check and
+// append under the append lock, report each result
+// flush() for callers that need durability before they continue
+// query() / currentState() with the same snapshot reads as logread
+
+#include "gallery_log.h"
+#include "log_layout.h"
+#include "token_store.h"
+#include <algorithm>
+#include <chrono>
+
+static constexpr size_t MAX_BATCH = 1024;
+
+struct GalleryLog::Node {
+    std::atomic<Node*> next{nullptr};
+    int64_t timestamp = 0;
+    Action action = Action::Enter;
+    Room room = Room::None;
+    GalleryId personId;
+    AppendCallback done;
+};
+
+// One dequeued event, copied out of its node.
+struct GalleryLog::Pending {
+    LogEntry entry;
+    AppendCallback done;
+};
+
+std::unique_ptr<GalleryLog> GalleryLog::open(const std::string& token, std::string* error) {
+    auto fail = [&](const char* msg) {
+        if (error) *error = msg;
+        return std::unique_ptr<GalleryLog>();
+    };
+
+    std::unique_ptr<GalleryLog> log(new GalleryLog());
+    {
+        const auto store = getTokenStore();
+        const UserTokenInfo* user = authenticateToken(token, Operation::Append, store);
+        if (!user) return fail("authentication failed");
+        log->tokenHash_ = user->tokenHash;
+        log->permission_ = user->permission;
+        log->actorId_ = user->actorId;
+        log->canRead_ = permissionAllows(user->permission, Operation::Read);
+    }
+
+    if (!log->writeDict_.load(ID_DICT_PATH)) return fail("failed to open ID dictionary");
+    if (log->canRead_ && !log->readDict_.loadReadOnly(ID_DICT_PATH)) return fail("failed to open ID dictionary");
+
+    Node* stub = new Node();
+    log->head_ = stub;
+    log->tail_.store(stub, std::memory_order_relaxed);
+    log->writer_ = std::thread(&GalleryLog::writerLoop, log.get());
+    return log;
+}
+
+GalleryLog::~GalleryLog() {
+    if (writer_.joinable()) {
+        stopping_.store(true);
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+        }
+        wakeWriter_.notify_one();
+        writer_.join();
+    }
+    delete head_;
+}
+
+bool GalleryLog::append(const GalleryEvent& ev, AppendCallback done) {
+    if (!validatePersonId(ev.personId)) return false;
+
+    Node* n = new Node();
+    n->timestamp = getCurrentTimestamp();
+    n->action = ev.action;
+    n->room = ev.room;
+    n->personId.assign(ev.personId);
+    n->done = std::move(done);
+    push(n, n, 1);
+    return true;
+}
+
+bool GalleryLog::appendBatch(const GalleryEvent* events, size_t count, AppendCallback done) {
+    for (size_t i = 0; i < count; ++i) {
+        if (!validatePersonId(events[i].personId)) return false;
+    }
+    if (count == 0) return true;
+
+    // Link the batch privately first; it becomes visible in one exchange.
+    const int64_t ts = getCurrentTimestamp();
+    Node* first = nullptr;
+    Node* last = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        Node* n = new Node();
+        n->timestamp = ts;
+        n->action = events[i].action;
+        n->room = events[i].room;
+        n->personId.assign(events[i].personId);
+        n->done = done;
+        if (last) last->next.store(n, std::memory_order_relaxed);
+        else first = n;
+        last = n;
+    }
+    push(first, last, count);
+    return true;
+}
+
+void GalleryLog::push(Node* first, Node* last, size_t count) {
+    enqueued_.fetch_add(count, std::memory_order_relaxed);
+
+    Node* prev = tail_.exchange(last, std::memory_order_acq_rel);
+    prev->next.store(first, std::memory_order_release);
+
+    // Only pay for a wakeup when the writer is actually asleep. The fence
+    // pairs with the one in writerLoop: either we see it idle, or it sees
+    // our node before it sleeps.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writerIdle_.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+        }
+        wakeWriter_.notify_one();
+    }
+}
+
+// Writer thread only. Returns the node holding the next event; it stays
+// in the queue as the new stub until the following pop().
+GalleryLog::Node* GalleryLog::pop() {
+    Node* head = head_;
+    Node* next = head->next.load(std::memory_order_acquire);
+    if (!next) return nullptr; // empty, or a producer is between exchange and link
+    head_ = next;
+    delete head;
+    return next;
+}
+
+void GalleryLog::flush() {
+    const uint64_t target = enqueued_.load();
+    std::unique_lock<std::mutex> lk(mutex_);
+    batchDone_.wait(lk, [&] { return completed_.load() >= target; });
+}
+
+void GalleryLog::writerLoop() {
+    std::vector<Pending> batch;
+    batch.reserve(MAX_BATCH);
+
+    while (true) {
+        batch.clear();
+        while (batch.size() < MAX_BATCH) {
+            Node* n = pop();
+            if (!n) break;
+            Pending p;
+            p.entry.timestamp = n->timestamp;
+            p.entry.actorId = actorId_;
+            p.entry.personId = n->personId;
+            p.entry.action = n->action;
+            p.entry.room = n->room;
+            p.done = std::move(n->done);
+            batch.push_back(std::move(p));
+        }
+
+        if (batch.empty()) {
+            // Stop once nothing is queued and no push is half done.
+            if (stopping_.load() && tail_.load() == head_) break;
+
+            std::unique_lock<std::mutex> lk(mutex_);
+            writerIdle_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!head_->next.load(std::memory_order_relaxed) && !stopping_.load()) {
+                wakeWriter_.wait_for(lk, std::chrono::milliseconds(10));
+            }
+            writerIdle_.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        writeBatch(batch);
+
+        completed_.fetch_add(batch.size());
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+        }
+        batchDone_.notify_all();
+    }
+}
+
+bool GalleryLog::authorized() const {
+    const auto store = getTokenStore();
+    const UserTokenInfo* user = store->find(tokenHash_);
+    return user && user->actorId == actorId_ && user->permission == permission_;
+}
+
+void GalleryLog::writeBatch(std::vector<Pending>& batch) {
+    auto report = [](Pending& p, const std::string& result) {
+        if (p.done) p.done(result);
+    };
+
+    if (!authorized()) {
+        for (auto& p : batch) report(p, "token revoked");
+        return;
+    }
+
+    LogLayout layout;
+    if (!loadLogLayout(layout)) {
+        for (auto& p : batch) report(p, "failed to read shard manifest");
+        return;
+    }
+
+    // Route events to their segment; all events of one person go to the
+    // same shard, so per-person order is kept.
+    std::map<std::string, std::vector<size_t>> bySegment;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        bySegment[layout.pathFor(batch[i].entry.personId)].push_back(i);
+    }
+
+    std::vector<LogEntry> entries;
+    std::vector<std::string> verdicts;
+    for (const auto& [path, indexes] : bySegment) {
+        entries.clear();
+        for (size_t i : indexes) entries.push_back(batch[i].entry);
+
+        long n = appendToSegment(path, writeDict_, writeSegments_[path], entries, verdicts);
+        for (size_t k = 0; k < indexes.size(); ++k) {
+            report(batch[indexes[k]], n < 0 ? std::string("failed to append event batch") : verdicts[k]);
+        }
+    }
+}
+
+static bool matches(const LogFilter& f, const LogEntry& e) {
+    if (!f.personId.empty() && e.personId != f.personId) return false;
+    if (!f.anyAction && e.action != f.action) return false;
+    if (!f.anyRoom && e.room != f.room) return false;
+    return e.timestamp >= f.fromTimestamp && e.timestamp <= f.toTimestamp;
+}
+
+bool collectLog(const LogFilter& filter, std::vector<LogEntry>& out, std::string* error) {
+    auto fail = [&](const std::string& msg) {
+        if (error) *error = msg;
+        return false;
+    };
+
+    LogLayout layout;
+    if (!loadLogLayout(layout)) return fail("failed to read shard manifest");
+
+    std::vector<SegmentData> segments;
+    std::string msg;
+    if (!readSegments(layout.segmentPaths(), segments, msg)) return fail(msg);
+    for (auto& seg : segments) {
+        auto& list = seg.entries;
+        list.erase(std::remove_if(list.begin(), list.end(),
+                                  [&](const LogEntry& e) { return !matches(filter, e); }),
+                   list.end());
+    }
+
+    out = layout.sharded() ? mergeByTimestamp(segments) : std::move(segments[0].entries);
+    return true;
+}
+
+bool queryLog(const LogFilter& filter, const std::function<void(const LogEntry&)>& fn,
+              std::string* error) {
+    std::vector<LogEntry> entries;
+    if (!collectLog(filter, entries, error)) return false;
+    for (const auto& e : entries) fn(e);
+    return true;
+}
+
+bool GalleryLog::query(const LogFilter& filter, const std::function<void(const LogEntry&)>& fn,
+                       std::string* error) {
+    if (!canRead_) {
+        if (error) *error = "token lacks READ permission";
+        return false;
+    }
+    return queryLog(filter, fn, error);
+}
+
+bool GalleryLog::currentState(std::vector<PersonLocation>& out, std::string* error) {
+    auto fail = [&](const std::string& msg) {
+        if (error) *error = msg;
+        return false;
+    };
+    if (!canRead_) return fail("token lacks READ permission");
+
+    LogLayout layout;
+    if (!loadLogLayout(layout)) return fail("failed to read shard manifest");
+
+    std::lock_guard<std::mutex> lk(readMutex_);
+
+    // Keep cached state only for segments that are still active.
+    std::map<std::string, SegmentState> segments;
+    for (const auto& path : layout.segmentPaths()) {
+        auto it = readSegments_.find(path);
+        SegmentState& live = segments[path];
+        if (it != readSegments_.end()) live = std::move(it->second);
+        if (!refreshSegment(path, readDict_, live)) {
+            readSegments_.clear();
+            return fail("failed to read log file");
+        }
+    }
+    readSegments_ = std::move(segments);
+
+    out.clear();
+    for (const auto& [path, live] : readSegments_) {
+        for (uint32_t idx = 0; idx < live.state.size(); ++idx) {
+            if (live.state[idx].inside()) {
+                out.push_back({std::string(readDict_.name(idx)), live.state[idx].room()});
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,148 @@
+// gallery_log.{h,cpp}
+// -------------------------------------
+// Embeddable, thread-safe API to the gallery log (libgallerylog), for
+// services that would otherwise spawn logappend / logread per event.
+//
+// Any number of threads call append()/appendBatch(). Each event goes into
+// a lock-free MPSC queue (one atomic exchange per call, no syscalls) and a
+// single writer thread owned by the GalleryLog drains it in batches: it
+// is the only thread that takes the log's append lock, and it checks the
+// gallery rules against live state exactly like logappend / logingest
+// (see log_segment.h). Results come back through an optional callback,
+// and flush() waits until everything enqueued so far has been handled.
+//
+// query() and currentState() read the log like logread: no lock is held
+// while parsing, so they never block the writer for long.
+
+#ifndef GALLERY_LOG_H
+#define GALLERY_LOG_H
+
+#include "security_utils.h"
+#include "id_dictionary.h"
+#include "log_segment.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One event to append; the actor is the authenticated token's actorId
+// and the timestamp is taken when the event is enqueued.
+struct GalleryEvent {
+    std::string personId;
+    Action action;
+    Room room;             // Room::None for "-"
+};
+
+// Filter for query(); unset fields match everything.
+struct LogFilter {
+    std::string personId;                   // empty = every person
+    bool anyAction = true;
+    Action action = Action::Enter;
+    bool anyRoom = true;
+    Room room = Room::None;
+    int64_t fromTimestamp = 0;              // inclusive, microseconds (see LogEntry)
+    int64_t toTimestamp = INT64_MAX;        // inclusive
+};
+
+struct PersonLocation {
+    std::string personId;
+    Room room;
+};
+
+// What GalleryLog::query() does, for read-only callers that have no
+// append token (the caller checks READ permission).
+bool queryLog(const LogFilter& filter, const std::function<void(const LogEntry&)>& fn,
+              std::string* error = nullptr);
+
+// Same, but hands back every matching entry at once (logd keeps them to
+// stream a reply in pieces).
+bool collectLog(const LogFilter& filter, std::vector<LogEntry>& out, std::string* error = nullptr);
+
+// Called on the writer thread once the event is durable (error empty) or
+// rejected (error says why). Keep it short: it delays the next batch.
+using AppendCallback = std::function<void(const std::string& error)>;
+
+class GalleryLog {
+public:
+    // Authenticates token for APPEND; query()/currentState() additionally
+    // need READ. Returns nullptr (error set) on failure.
+    static std::unique_ptr<GalleryLog> open(const std::string& token, std::string* error = nullptr);
+
+    ~GalleryLog(); // handles everything still queued, then stops the writer
+    GalleryLog(const GalleryLog&) = delete;
+    GalleryLog& operator=(const GalleryLog&) = delete;
+
+    // Enqueue one event. Returns false (nothing enqueued) if the person ID
+    // is invalid. done is optional and may be empty.
+    bool append(const GalleryEvent& ev, AppendCallback done = {});
+
+    // Enqueue count events in order with a single atomic exchange; done is
+    // called once per event. Returns false (nothing enqueued) if any person
+    // ID is invalid.
+    bool appendBatch(const GalleryEvent* events, size_t count, AppendCallback done = {});
+    bool appendBatch(const std::vector<GalleryEvent>& events, AppendCallback done = {}) {
+        return appendBatch(events.data(), events.size(), std::move(done));
+    }
+
+    // Blocks until every event enqueued before the call is written or rejected.
+    void flush();
+
+    // False once the current token store (see reloadTokenStore) no longer
+    // maps the token to the actor and permission it was opened with; from
+    // then on every batch is rejected with "token revoked".
+    bool authorized() const;
+
+    // Calls fn for every matching entry, in timestamp order across shards.
+    bool query(const LogFilter& filter, const std::function<void(const LogEntry&)>& fn,
+               std::string* error = nullptr);
+
+    // People currently inside and their rooms.
+    bool currentState(std::vector<PersonLocation>& out, std::string* error = nullptr);
+
+private:
+    struct Node;
+    struct Pending;
+
+    GalleryLog() = default;
+    void push(Node* first, Node* last, size_t count);
+    Node* pop();
+    void writerLoop();
+    void writeBatch(std::vector<Pending>& batch);
+
+    Digest tokenHash_{};      // rechecked against the store for every batch
+    Permission permission_{};
+    GalleryId actorId_;
+    bool canRead_ = false;
+
+    // MPSC queue (D. Vyukov's intrusive node queue): producers exchange the
+    // tail, the writer thread walks from head_. head_ always points at an
+    // already-consumed stub node.
+    alignas(64) std::atomic<Node*> tail_{nullptr};
+    alignas(64) Node* head_ = nullptr;
+
+    std::atomic<uint64_t> enqueued_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<bool> writerIdle_{false};
+    std::atomic<bool> stopping_{false};
+    std::mutex mutex_;
+    std::condition_variable wakeWriter_;
+    std::condition_variable batchDone_;
+    std::thread writer_;
+
+    // writer thread only
+    IdDictionary writeDict_;
+    std::map<std::string, SegmentState> writeSegments_;
+
+    // query side
+    std::mutex readMutex_;
+    IdDictionary readDict_; // read-only: queries never touch gallery.ids
+    std::map<std::string, SegmentState> readSegments_;
+};
+
+#endif // GALLERY_LOG_H
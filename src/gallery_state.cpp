@@ -0,0 +1,217 @@
+// gallery_state.{h,cpp}
+// -------------------------------------
+// Shared replay of the gallery log into per-person state.
+//
+// responsibilities:
+// apply events to the per-person state table
+// replay a locked log file, including checkpoint records; new IDs are
+// interned in one batch after the scan, not under a lock held across it
+// format and parse checkpoint records written by logcompact
+
+#include "gallery_state.h"
+#include <charconv>        // std::from_chars
+#include <unordered_map>
+#include <sys/stat.h>      // fstat
+
+static constexpr std::string_view CHECKPOINT_TAG = "#checkpoint|";
+static constexpr std::string_view STATE_TAG      = "#state|";
+
+void applyEvent(StateTable& state, uint32_t personIdx, Action action, Room room) {
+    if (personIdx >= state.size()) state.resize(personIdx + 1);
+    auto& ps = state[personIdx];
+
+    switch (action) {
+        case Action::Enter:
+        case Action::Move:
+            ps.bits = PersonState::INSIDE | static_cast<uint8_t>(room);
+            break;
+        case Action::Exit:
+            ps = PersonState();
+            break;
+    }
+}
+
+std::string checkEvent(const StateTable& state, uint32_t personIdx, std::string_view personId,
+                       Action action, Room room) {
+    const std::string pid(personId);
+
+    // checks if person exists in log
+    bool currentlyKnown = (personIdx != IdDictionary::NOT_FOUND && personIdx < state.size());
+    // checks if person is inside the gallery
+    bool currentlyInside = currentlyKnown && state[personIdx].inside();
+    // current room person is in
+    Room currentRoom = currentlyInside ? state[personIdx].room() : Room::None;
+
+    switch (action) {
+        case Action::Enter:
+            // Person cannot ENTER if already inside
+            if (currentlyInside) {
+                return "person '" + pid + "' is already inside (in room '" +
+                       std::string(roomName(currentRoom)) + "'), cannot ENTER again";
+            }
+            // For ENTER, roomId should be a real room, not "-"
+            if (room == Room::None) return "ENTER requires a concrete room, not '-'";
+            break;
+
+        case Action::Move:
+            // Must already be inside to MOVE
+            if (!currentlyInside) return "person '" + pid + "' is not currently inside, cannot MOVE";
+            // Cannot MOVE to the same room
+            if (room == currentRoom) {
+                return "person '" + pid + "' is already in room '" +
+                       std::string(roomName(room)) + "', cannot MOVE to the same room";
+            }
+            // Moving to "-" makes no sense
+            if (room == Room::None) return "MOVE requires a concrete room, not '-'";
+            break;
+
+        case Action::Exit:
+            // Must be inside to EXIT
+            if (!currentlyInside) return "person '" + pid + "' is not currently inside, cannot EXIT";
+            // For EXIT, either roomId == "-" or matches the current room
+            if (!(room == Room::None || room == currentRoom)) {
+                return "EXIT room '" + std::string(roomName(room)) +
+                       "' does not match current room '" + std::string(roomName(currentRoom)) +
+                       "' for person '" + pid + "'";
+            }
+            break;
+    }
+    return std::string();
+}
+
+bool replayLog(int fd, IdDictionary& dict, StateTable& state,
+               off_t from, off_t* replayedTo, off_t end) {
+    struct stat st;
+    if (end < 0) {
+        if (::fstat(fd, &st) != 0) return false;
+        end = st.st_size;
+    }
+
+    // The scan only looks IDs up, so it holds no dictionary lock. IDs seen
+    // for the first time get a local slot and their people a local state;
+    // a person's state depends only on their own events and checkpoints,
+    // so it can be moved to the real index once the IDs are interned.
+    std::unordered_map<GalleryId, uint32_t> fresh; // ID -> local slot
+    std::vector<GalleryId> freshIds;               // first-seen order
+    StateTable freshState;
+    auto resolve = [&](const GalleryId& id, StateTable*& table) {
+        uint32_t idx = dict.lookup(id);
+        if (idx != IdDictionary::NOT_FOUND) {
+            table = &state;
+            return idx;
+        }
+        auto [it, added] = fresh.try_emplace(id, static_cast<uint32_t>(freshIds.size()));
+        if (added) freshIds.push_back(id);
+        table = &freshState;
+        return it->second;
+    };
+
+    StateTable* table;
+    bool ok = forEachLine(fd, from, end, [&](std::string_view line, const LineMasks& masks) {
+        LogEntry e;
+        if (parseLogLine(line, masks, e)) {
+            resolve(e.actorId, table);
+            uint32_t idx = resolve(e.personId, table);
+            applyEvent(*table, idx, e.action, e.room);
+            return;
+        }
+
+        GalleryId personId;
+        int64_t ts;
+        size_t count;
+        Room room;
+        if (parseCheckpointHeader(line, ts, count)) {
+            // everything before the checkpoint is folded into it
+            for (auto& ps : state) ps = PersonState();
+            for (auto& ps : freshState) ps = PersonState();
+        } else if (parseCheckpointState(line, personId, room)) {
+            uint32_t idx = resolve(personId, table);
+            applyEvent(*table, idx, Action::Enter, room);
+        }
+        // Malformed or invalid entry -> skip defensively
+    });
+    if (replayedTo) *replayedTo = end;
+    if (freshIds.empty()) return ok;
+
+    // New IDs are written in one short batch (a read-only dictionary
+    // indexes them locally and needs no lock).
+    if (!dict.readOnly() && !dict.beginUpdate()) return false;
+    for (uint32_t slot = 0; slot < freshIds.size(); ++slot) {
+        uint32_t idx = dict.intern(freshIds[slot]);
+        if (idx == IdDictionary::NOT_FOUND) {
+            ok = false;
+            continue;
+        }
+        if (slot < freshState.size()) {
+            if (idx >= state.size()) state.resize(idx + 1);
+            state[idx] = freshState[slot];
+        }
+    }
+    return (dict.readOnly() || dict.commitUpdate()) && ok;
+}
+
+void appendCheckpointHeader(std::string& out, int64_t timestamp, size_t count) {
+    out.append(CHECKPOINT_TAG.data(), CHECKPOINT_TAG.size());
+    out.append(formatTimestamp(timestamp));
+    out.push_back('|');
+    out.append(std::to_string(count));
+    out.push_back('\n');
+}
+
+void appendCheckpointState(std::string& out, std::string_view personId, Room room) {
+    const std::string_view name = roomName(room);
+    out.append(STATE_TAG.data(), STATE_TAG.size());
+    out.append(personId.data(), personId.size());
+    out.push_back('|');
+    out.append(name.data(), name.size());
+    out.push_back('\n');
+}
+
+std::string formatCheckpoint(const StateTable& state, const IdDictionary& dict,
+                             int64_t timestamp) {
+    size_t count = 0;
+    for (const auto& ps : state) count += ps.inside();
+
+    std::string out;
+    appendCheckpointHeader(out, timestamp, count);
+    for (uint32_t idx = 0; idx < state.size(); ++idx) {
+        if (state[idx].inside()) appendCheckpointState(out, dict.name(idx), state[idx].room());
+    }
+    return out;
+}
+
+bool parseCheckpointHeader(std::string_view line, int64_t& timestamp, size_t& count) {
+    if (line.substr(0, CHECKPOINT_TAG.size()) != CHECKPOINT_TAG) return false;
+    line.remove_prefix(CHECKPOINT_TAG.size());
+
+    size_t bar = line.find('|');
+    if (bar == std::string_view::npos) return false;
+    std::string_view ts = line.substr(0, bar);
+    std::string_view n  = line.substr(bar + 1);
+    int64_t when;
+    if (!parseTimestamp(ts, when)) return false;
+
+    size_t value = 0;
+    auto res = std::from_chars(n.data(), n.data() + n.size(), value);
+    if (res.ec != std::errc() || res.ptr != n.data() + n.size() || n.empty()) return false;
+
+    timestamp = when;
+    count = value;
+    return true;
+}
+
+bool parseCheckpointState(std::string_view line, GalleryId& personId, Room& room) {
+    if (line.substr(0, STATE_TAG.size()) != STATE_TAG) return false;
+    line.remove_prefix(STATE_TAG.size());
+
+    size_t bar = line.find('|');
+    if (bar == std::string_view::npos) return false;
+    std::string_view pid = line.substr(0, bar);
+    Room r;
+    if (!validatePersonId(pid)) return false;
+    if (!parseRoom(line.substr(bar + 1), r) || r == Room::None) return false; // inside => real room
+
+    personId.assign(pid);
+    room = r;
+    return true;
+}
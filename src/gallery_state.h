@@ -0,0 +1,67 @@
+// gallery_state.{h,cpp}
+// -------------------------------------
+// Shared replay of the gallery log into per-person state.
+// Used by logappend (rule checks), logread and logcompact (checkpoints).
+//
+// Checkpoint records are written by logcompact at the start of a new
+// segment and fold all earlier history into the current inside/room map:
+//   #checkpoint|<timestamp>|<count>
+//   #state|<personId>|<room>          (count lines, one per person inside)
+// parseLogLine rejects these lines, so tools that only know about events
+// skip them like any other non-event line.
+
+#ifndef GALLERY_STATE_H
+#define GALLERY_STATE_H
+
+#include "security_utils.h"
+#include "id_dictionary.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Current state of a person in one byte: the room code in the low bits,
+// INSIDE on top. Room::None while outside.
+struct PersonState {
+    static constexpr uint8_t INSIDE = 0x80;
+    uint8_t bits = static_cast<uint8_t>(Room::None);
+
+    bool inside() const { return bits & INSIDE; }
+    Room room() const { return static_cast<Room>(bits & ~INSIDE); }
+};
+
+// Per-person state indexed by IdDictionary index: a dense array, one
+// byte per person ever seen.
+using StateTable = std::vector<PersonState>;
+
+// Apply one event. For existing log entries we assume they were valid
+// when written, so no rule checks happen here.
+void applyEvent(StateTable& state, uint32_t personIdx, Action action, Room room);
+
+// Gallery rules for a NEW event (personIdx may be IdDictionary::NOT_FOUND):
+//      ENTER: only if person is not inside; room must be real (not "-")
+//      MOVE:  only if person is inside; new room != current; not "-"
+//      EXIT:  only if person is inside; room must be "-" or current room
+// Returns an empty string if allowed, otherwise why the event is rejected.
+std::string checkEvent(const StateTable& state, uint32_t personIdx, std::string_view personId,
+                       Action action, Room room);
+
+// Replays the log open at fd from offset `from` to `end` (< 0: its current
+// end; caller holds the log lock), interning every ID into dict (only
+// locally when dict is read-only). The scan runs without the dictionary
+// lock; IDs it had not seen are interned together at the end. A
+// checkpoint record replaces all state before it. Long-running writers
+// pass the previous end back in as `from` to only replay what other
+// writers appended. Returns false on a read or dictionary error.
+bool replayLog(int fd, IdDictionary& dict, StateTable& state,
+               off_t from = 0, off_t* replayedTo = nullptr, off_t end = -1);
+
+// Checkpoint record formatting & parsing
+std::string formatCheckpoint(const StateTable& state, const IdDictionary& dict,
+                             int64_t timestamp);
+// single records, '\n' included (formatCheckpoint is made of these)
+void appendCheckpointHeader(std::string& out, int64_t timestamp, size_t count);
+void appendCheckpointState(std::string& out, std::string_view personId, Room room);
+bool parseCheckpointHeader(std::string_view line, int64_t& timestamp, size_t& count);
+bool parseCheckpointState(std::string_view line, GalleryId& personId, Room& room);
+
+#endif // GALLERY_STATE_H
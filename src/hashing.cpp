@@ -0,0 +1,283 @@
+// hashing.{h,cpp}
+// -------------------------------------
+// SHA-256 through EVP, with a direct SHA-NI path for one-shot digests.
+//
+// responsibilities:
+// fetch the EVP_MD once, keep one EVP_MD_CTX per Sha256 object
+// detect the SHA extensions with cpuid and pick the backend once
+// SHA-NI block function plus padding for one-shot digests
+// batch hashing over the thread pool, one context per thread
+// HMAC-SHA256 with the key pads absorbed once per key
+// hex <-> Digest conversion
+
+#include "hashing.h"
+#include "thread_pool.h"
+#include <openssl/crypto.h>  // OPENSSL_cleanse
+#include <openssl/evp.h>
+#include <cstdlib>         // getenv, abort
+#include <cstring>         // memcpy, memset, strcmp
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define GALLERYLOG_HAVE_SHA_NI 1
+#endif
+
+// Above this the EVP call overhead no longer matters and OpenSSL's own
+// (also SHA-NI) code is at least as fast.
+static constexpr size_t SHA_NI_DIRECT_MAX = 1024;
+
+static const EVP_MD* sha256Md() {
+    // EVP_sha256() would look the algorithm up again on every init.
+    static EVP_MD* md = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    if (!md) std::abort();
+    return md;
+}
+
+#ifdef GALLERYLOG_HAVE_SHA_NI
+
+static bool cpuHasShaNi() {
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+    const bool ssse3 = c & (1u << 9), sse41 = c & (1u << 19);
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+    return ssse3 && sse41 && (b & (1u << 29));
+}
+
+alignas(16) static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// Compresses `blocks` 64-byte blocks into state (a..h). Four rounds per
+// step: two sha256rnds2, and the message words for step g + 4 computed
+// with sha256msg1/msg2 once step g has used its own.
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256BlocksShaNi(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i BSWAP = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // a..h -> the ABEF / CDGH register halves the instructions expect
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);
+    __m128i cdgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);
+    __m128i abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+    for (; blocks; --blocks, data += 64) {
+        const __m128i abefSaved = abef, cdghSaved = cdgh;
+        __m128i w[4];
+        for (int i = 0; i < 4; ++i) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), BSWAP);
+        }
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; ++g) {
+            __m128i wk = _mm_add_epi32(w[g & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(&K256[4 * g])));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0E));
+            if (g < 12) {
+                __m128i next = _mm_sha256msg1_epu32(w[g & 3], w[(g + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(w[(g + 3) & 3], w[(g + 2) & 3], 4));
+                w[g & 3] = _mm_sha256msg2_epu32(next, w[(g + 3) & 3]);
+            }
+        }
+        abef = _mm_add_epi32(abef, abefSaved);
+        cdgh = _mm_add_epi32(cdgh, cdghSaved);
+    }
+
+    tmp = _mm_shuffle_epi32(abef, 0x1B);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(tmp, cdgh, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+static constexpr uint32_t SHA256_IV[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// Hashes data on top of state, which already holds prefixLen bytes (a
+// multiple of 64), and writes the digest.
+static void sha256FinishShaNi(uint32_t state[8], uint64_t prefixLen, const uint8_t* data, size_t len,
+                              Digest& out) {
+    const size_t full = len / 64;
+    sha256BlocksShaNi(state, data, full);
+
+    // Tail, 0x80, zeros, then the bit length: one or two more blocks.
+    uint8_t tail[128];
+    const size_t rest = len - full * 64;
+    const size_t tailLen = rest < 56 ? 64 : 128;
+    std::memcpy(tail, data + full * 64, rest);
+    tail[rest] = 0x80;
+    std::memset(tail + rest + 1, 0, tailLen - rest - 1);
+    const uint64_t bits = (prefixLen + len) * 8;
+    for (int i = 0; i < 8; ++i) tail[tailLen - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+    sha256BlocksShaNi(state, tail, tailLen / 64);
+
+    for (int i = 0; i < 8; ++i) {
+        out[4 * i]     = static_cast<uint8_t>(state[i] >> 24);
+        out[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+        out[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+        out[4 * i + 3] = static_cast<uint8_t>(state[i]);
+    }
+}
+
+static void sha256ShaNi(const uint8_t* data, size_t len, Digest& out) {
+    uint32_t state[8];
+    std::memcpy(state, SHA256_IV, sizeof(state));
+    sha256FinishShaNi(state, 0, data, len, out);
+}
+
+#else
+
+static bool cpuHasShaNi() { return false; }
+
+#endif // GALLERYLOG_HAVE_SHA_NI
+
+Sha256Backend sha256Backend() {
+    static const Sha256Backend backend = [] {
+        const char* env = std::getenv("GALLERYLOG_SHA");
+        if (env && std::strcmp(env, "openssl") == 0) return Sha256Backend::OpenSsl;
+        return cpuHasShaNi() ? Sha256Backend::ShaNi : Sha256Backend::OpenSsl;
+    }();
+    return backend;
+}
+
+const char* sha256BackendName(Sha256Backend b) {
+    return b == Sha256Backend::ShaNi ? "sha-ni" : "openssl";
+}
+
+Sha256::Sha256() : ctx_(EVP_MD_CTX_new()) {
+    if (!ctx_) std::abort();
+}
+
+Sha256::~Sha256() {
+    EVP_MD_CTX_free(ctx_);
+}
+
+void Sha256::init() {
+    EVP_DigestInit_ex(ctx_, sha256Md(), nullptr);
+}
+
+void Sha256::update(const void* data, size_t len) {
+    EVP_DigestUpdate(ctx_, data, len);
+}
+
+void Sha256::final(Digest& out) {
+    EVP_DigestFinal_ex(ctx_, out.data(), nullptr);
+}
+
+void Sha256::digest(const void* data, size_t len, Digest& out) {
+#ifdef GALLERYLOG_HAVE_SHA_NI
+    if (len <= SHA_NI_DIRECT_MAX && sha256Backend() == Sha256Backend::ShaNi) {
+        sha256ShaNi(static_cast<const uint8_t*>(data), len, out);
+        return;
+    }
+#endif
+    init();
+    update(data, len);
+    final(out);
+}
+
+void sha256Many(const std::string_view* inputs, size_t count, Digest* out) {
+    // Small inputs hash in well under a microsecond; only hand out ranges
+    // big enough to be worth a task.
+    constexpr size_t GRAIN = 4096;
+    parallelFor(0, count, GRAIN, [&](size_t b, size_t e) {
+        thread_local Sha256 hasher;
+        for (size_t i = b; i < e; ++i) {
+            hasher.digest(inputs[i].data(), inputs[i].size(), out[i]);
+        }
+    });
+}
+
+HmacSha256::HmacSha256(const Digest& key) {
+    constexpr size_t BLOCK = 64;
+    uint8_t ipad[BLOCK], opad[BLOCK];
+    for (size_t i = 0; i < BLOCK; ++i) {
+        const uint8_t k = i < key.size() ? key[i] : 0;
+        ipad[i] = k ^ 0x36;
+        opad[i] = k ^ 0x5c;
+    }
+
+#ifdef GALLERYLOG_HAVE_SHA_NI
+    shaNi_ = sha256Backend() == Sha256Backend::ShaNi;
+    if (shaNi_) {
+        std::memcpy(inner_, SHA256_IV, sizeof(inner_));
+        std::memcpy(outer_, SHA256_IV, sizeof(outer_));
+        sha256BlocksShaNi(inner_, ipad, 1);
+        sha256BlocksShaNi(outer_, opad, 1);
+    }
+#endif
+    if (!shaNi_) {
+        innerCtx_ = EVP_MD_CTX_new();
+        outerCtx_ = EVP_MD_CTX_new();
+        work_ = EVP_MD_CTX_new();
+        if (!innerCtx_ || !outerCtx_ || !work_) std::abort();
+        EVP_DigestInit_ex(innerCtx_, sha256Md(), nullptr);
+        EVP_DigestUpdate(innerCtx_, ipad, BLOCK);
+        EVP_DigestInit_ex(outerCtx_, sha256Md(), nullptr);
+        EVP_DigestUpdate(outerCtx_, opad, BLOCK);
+    }
+    OPENSSL_cleanse(ipad, BLOCK);
+    OPENSSL_cleanse(opad, BLOCK);
+}
+
+HmacSha256::~HmacSha256() {
+    OPENSSL_cleanse(inner_, sizeof(inner_));
+    OPENSSL_cleanse(outer_, sizeof(outer_));
+    EVP_MD_CTX_free(innerCtx_); // null-safe; frees clear the pad state
+    EVP_MD_CTX_free(outerCtx_);
+    EVP_MD_CTX_free(work_);
+}
+
+void HmacSha256::mac(std::string_view msg, Digest& out) {
+    Digest inner;
+#ifdef GALLERYLOG_HAVE_SHA_NI
+    if (shaNi_) {
+        uint32_t state[8];
+        std::memcpy(state, inner_, sizeof(state));
+        sha256FinishShaNi(state, 64, reinterpret_cast<const uint8_t*>(msg.data()), msg.size(), inner);
+        std::memcpy(state, outer_, sizeof(state));
+        sha256FinishShaNi(state, 64, inner.data(), inner.size(), out);
+        return;
+    }
+#endif
+    EVP_MD_CTX_copy_ex(work_, innerCtx_);
+    EVP_DigestUpdate(work_, msg.data(), msg.size());
+    EVP_DigestFinal_ex(work_, inner.data(), nullptr);
+    EVP_MD_CTX_copy_ex(work_, outerCtx_);
+    EVP_DigestUpdate(work_, inner.data(), inner.size());
+    EVP_DigestFinal_ex(work_, out.data(), nullptr);
+}
+
+void hmacSha256(const Digest& key, std::string_view msg, Digest& out) {
+    HmacSha256(key).mac(msg, out);
+}
+
+bool digestFromHex(std::string_view hex, Digest& out) {
+    if (hex.size() != 2 * SHA256_BYTES) return false;
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < SHA256_BYTES; ++i) {
+        int hi = nibble(hex[2 * i]), lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return true;
+}
+
+std::string digestToHex(const Digest& d) {
+    static const char* HEX = "0123456789abcdef";
+    std::string s(2 * SHA256_BYTES, '0');
+    for (size_t i = 0; i < SHA256_BYTES; ++i) {
+        s[2 * i] = HEX[d[i] >> 4];
+        s[2 * i + 1] = HEX[d[i] & 0xF];
+    }
+    return s;
+}
@@ -0,0 +1,111 @@
+// hashing.{h,cpp}
+// -------------------------------------
+// SHA-256 for everything that hashes: tokens, and (soon) chained records.
+//
+// Sha256 owns one EVP_MD_CTX for its whole life and the EVP_MD is fetched
+// once per process, so hashing many inputs costs no allocation and no
+// algorithm lookup per call. OpenSSL's own SHA-256 code already uses the
+// x86 SHA extensions (SHA-NI) or the ARMv8 SHA2 instructions when present.
+//
+// digest() of a short input (up to 1 KiB) skips EVP altogether on CPUs
+// with SHA-NI: padding is done here and the blocks go straight to the
+// SHA-NI rounds. For inputs of a few dozen bytes the EVP call overhead is
+// larger than the compression itself. GALLERYLOG_SHA=openssl turns this
+// off.
+//
+// sha256Many() hashes a batch of independent inputs, split over the
+// shared thread pool (thread_pool.h) with one context per thread.
+//
+// Digests are kept as 32 raw bytes (Digest) everywhere; hex exists only
+// where digests are read from or shown to people.
+
+#ifndef HASHING_H
+#define HASHING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+typedef struct evp_md_ctx_st EVP_MD_CTX; // as in <openssl/types.h>
+
+inline constexpr size_t SHA256_BYTES = 32;
+
+using Digest = std::array<uint8_t, SHA256_BYTES>;
+
+// Zero iff a == b. Always reads and combines all four 64-bit words, so
+// the time does not depend on where the digests differ.
+inline uint64_t digestDiff(const Digest& a, const Digest& b) {
+    uint64_t diff = 0;
+    for (size_t i = 0; i < SHA256_BYTES; i += sizeof(uint64_t)) {
+        uint64_t x, y;
+        std::memcpy(&x, a.data() + i, sizeof(x));
+        std::memcpy(&y, b.data() + i, sizeof(y));
+        diff |= x ^ y;
+    }
+    return diff;
+}
+
+inline bool constantTimeEquals(const Digest& a, const Digest& b) {
+    return digestDiff(a, b) == 0;
+}
+
+// Hex boundary: 64 hex digits (either case) <-> Digest.
+bool digestFromHex(std::string_view hex, Digest& out);
+std::string digestToHex(const Digest& d);
+
+enum class Sha256Backend { OpenSsl, ShaNi };
+
+// Chosen once per process: ShaNi if the CPU has it and GALLERYLOG_SHA is
+// not "openssl".
+Sha256Backend sha256Backend();
+const char* sha256BackendName(Sha256Backend b);
+
+class Sha256 {
+public:
+    Sha256();
+    ~Sha256();
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+
+    // One-shot hash of one input.
+    void digest(const void* data, size_t len, Digest& out);
+
+    // Streaming hash through the EVP context (inputs split over calls).
+    void init();
+    void update(const void* data, size_t len);
+    void final(Digest& out);
+
+private:
+    EVP_MD_CTX* ctx_;
+};
+
+// out[i] = SHA-256(inputs[i]) for i < count.
+void sha256Many(const std::string_view* inputs, size_t count, Digest* out);
+
+// HMAC-SHA256 (RFC 2104) with a 32-byte key. The key's inner and outer
+// pad blocks are hashed once, in the constructor, so each mac() of a
+// short message costs two SHA-256 blocks instead of four.
+class HmacSha256 {
+public:
+    explicit HmacSha256(const Digest& key);
+    ~HmacSha256();
+    HmacSha256(const HmacSha256&) = delete;
+    HmacSha256& operator=(const HmacSha256&) = delete;
+
+    void mac(std::string_view msg, Digest& out);
+
+private:
+    bool shaNi_ = false;
+    uint32_t inner_[8] = {}, outer_[8] = {}; // SHA-NI: state after each pad block
+    EVP_MD_CTX* innerCtx_ = nullptr;         // otherwise: contexts after each pad
+    EVP_MD_CTX* outerCtx_ = nullptr;
+    EVP_MD_CTX* work_ = nullptr;
+};
+
+// One-off HMAC (sets up the key every call).
+void hmacSha256(const Digest& key, std::string_view msg, Digest& out);
+
+#endif // HASHING_H
@@ -0,0 +1,237 @@
+// id_dictionary.{h,cpp}
+// -------------------------------------
+// Persistent append-only ID dictionary.
+//
+// responsibilities:
+// mmap the dictionary file and index every stored ID
+// hand out dense uint32 indexes for actor and person IDs
+// append new IDs under an exclusive lock on the dictionary file
+// pick up IDs appended by other processes before appending
+// forget IDs whose write failed, so indexes keep matching file lines
+// drop a torn trailing line left behind by a crashed writer
+// flat open-addressing index (linear probing, at most 3/4 full)
+// read-only mode for readers: no create, no lock, new IDs indexed locally
+
+#include "id_dictionary.h"
+#include "security_utils.h"
+#include <algorithm>       // max
+#include <cerrno>
+#include <sys/mman.h>      // mmap
+#include <sys/stat.h>      // fstat
+#include <fcntl.h>         // open flags
+#include <unistd.h>        // pread/write/ftruncate
+
+// Owned IDs are packed into buffers of this size.
+static constexpr size_t OWNED_CHUNK = 64 * 1024;
+
+IdDictionary::~IdDictionary() {
+    if (map_) ::munmap(map_, mapLen_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+void IdDictionary::addName(std::string_view name) {
+    const uint32_t idx = static_cast<uint32_t>(names_.size());
+
+    // Lines that fail validation keep their slot so later indexes stay
+    // stable, but can never be looked up.
+    if (!validatePersonId(name)) { // actor IDs use the same rules
+        names_.push_back(std::string_view());
+        return;
+    }
+    names_.push_back(name);
+
+    if ((indexed_ + 1) * 4 > slots_.size() * 3) growIndex(indexed_ + 1);
+    const uint32_t h = hashId(name);
+    const size_t mask = slots_.size() - 1;
+    size_t i = h & mask;
+    for (; slots_[i].idx != NOT_FOUND; i = (i + 1) & mask) {
+        if (slots_[i].hash == h && names_[slots_[i].idx] == name) return; // first index wins
+    }
+    slots_[i] = Slot{h, idx};
+    ++indexed_;
+}
+
+void IdDictionary::growIndex(size_t ids) {
+    size_t size = 64;
+    while (size * 3 < ids * 4) size *= 2;
+    if (size <= slots_.size()) return;
+
+    std::vector<Slot> old(size);
+    old.swap(slots_);
+    const size_t mask = size - 1;
+    for (const Slot& s : old) {
+        if (s.idx == NOT_FOUND) continue;
+        size_t i = s.hash & mask;
+        while (slots_[i].idx != NOT_FOUND) i = (i + 1) & mask;
+        slots_[i] = s;
+    }
+}
+
+void IdDictionary::truncateNames(size_t count) {
+    if (count >= names_.size()) return;
+    names_.resize(count);
+
+    // Linear probing has no cheap delete: reinsert the surviving slots.
+    std::vector<Slot> old(slots_.size());
+    old.swap(slots_);
+    const size_t mask = slots_.size() - 1;
+    indexed_ = 0;
+    for (const Slot& s : old) {
+        if (s.idx == NOT_FOUND || s.idx >= count) continue;
+        size_t i = s.hash & mask;
+        while (slots_[i].idx != NOT_FOUND) i = (i + 1) & mask;
+        slots_[i] = s;
+        ++indexed_;
+    }
+}
+
+std::string_view IdDictionary::keep(std::string_view id) {
+    // Appending within the reserved capacity never moves earlier IDs.
+    if (owned_.empty() || owned_.back().capacity() - owned_.back().size() < id.size()) {
+        owned_.emplace_back();
+        owned_.back().reserve(std::max(OWNED_CHUNK, id.size()));
+    }
+    std::string& buf = owned_.back();
+    const size_t at = buf.size();
+    buf.append(id.data(), id.size());
+    return std::string_view(buf.data() + at, id.size());
+}
+
+bool IdDictionary::load(const std::string& path) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (fd_ < 0) return false;
+    return mapFile();
+}
+
+bool IdDictionary::loadReadOnly(const std::string& path) {
+    readOnly_ = true;
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) return errno == ENOENT; // no IDs yet: everything is local
+    bool ok = mapFile();
+    ::close(fd_); // the mapping stays valid; nothing else needs the file
+    fd_ = -1;
+    return ok;
+}
+
+bool IdDictionary::mapFile() {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) return false;
+    if (st.st_size == 0) return true; // fresh dictionary
+
+    mapLen_ = static_cast<size_t>(st.st_size);
+    map_ = ::mmap(nullptr, mapLen_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        return false;
+    }
+
+    // Index every complete line; a trailing fragment without '\n' is
+    // left for catchUp() to resolve under the lock. IDs take about 16
+    // bytes a line, which sizes the index close to right up front.
+    growIndex(mapLen_ / 16);
+    const char* data = static_cast<const char*>(map_);
+    size_t start = 0;
+    for (size_t i = 0; i < mapLen_; ++i) {
+        if (data[i] == '\n') {
+            addName(std::string_view(data + start, i - start));
+            start = i + 1;
+        }
+    }
+    loadedBytes_ = static_cast<off_t>(start);
+    return true;
+}
+
+// Must be called with the dictionary lock held.
+bool IdDictionary::catchUp() {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) return false;
+    if (st.st_size <= loadedBytes_) return true;
+
+    // The new lines are kept as one owned buffer the names point into.
+    std::string& tail = owned_.emplace_back(static_cast<size_t>(st.st_size - loadedBytes_), '\0');
+    ssize_t n = ::pread(fd_, &tail[0], tail.size(), loadedBytes_);
+    if (n != static_cast<ssize_t>(tail.size())) return false;
+
+    size_t start = 0;
+    for (size_t i = 0; i < tail.size(); ++i) {
+        if (tail[i] == '\n') {
+            addName(std::string_view(tail.data() + start, i - start));
+            start = i + 1;
+        }
+    }
+    loadedBytes_ += static_cast<off_t>(start);
+
+    // Anything left is a torn line from a writer that died mid-write;
+    // nobody else can be writing while we hold the lock.
+    if (start < tail.size()) {
+        if (::ftruncate(fd_, loadedBytes_) != 0) return false;
+    }
+    return true;
+}
+
+uint32_t IdDictionary::lookup(std::string_view id) const {
+    if (slots_.empty()) return NOT_FOUND;
+    const uint32_t h = hashId(id);
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = h & mask; slots_[i].idx != NOT_FOUND; i = (i + 1) & mask) {
+        if (slots_[i].hash == h && names_[slots_[i].idx] == id) return slots_[i].idx;
+    }
+    return NOT_FOUND;
+}
+
+bool IdDictionary::beginUpdate() {
+    if (fd_ < 0 || !lockFile(fd_, true, &lockStats_)) return false;
+    if (!catchUp()) {
+        unlockFile(fd_, &lockStats_);
+        return false;
+    }
+    committedNames_ = names_.size();
+    updating_ = true;
+    return true;
+}
+
+bool IdDictionary::commitUpdate() {
+    bool ok = true;
+    if (!pending_.empty()) {
+        ssize_t n = ::write(fd_, pending_.data(), pending_.size());
+        ok = (n == static_cast<ssize_t>(pending_.size()));
+        if (ok) loadedBytes_ += static_cast<off_t>(pending_.size());
+        // Otherwise the indexes handed out since beginUpdate() are not in
+        // the file: forget them, so the next catchUp() numbers whatever
+        // lines did land (a torn one is truncated) from the right index.
+        else truncateNames(committedNames_);
+        pending_.clear();
+    }
+    updating_ = false;
+    unlockFile(fd_, &lockStats_);
+    return ok;
+}
+
+uint32_t IdDictionary::intern(std::string_view id) {
+    uint32_t idx = lookup(id);
+    if (idx != NOT_FOUND) return idx;
+
+    if (readOnly_) {
+        idx = static_cast<uint32_t>(names_.size());
+        addName(keep(id));
+        return idx;
+    }
+
+    // One-off intern: take the lock just for this ID.
+    if (!updating_) {
+        if (!beginUpdate()) return NOT_FOUND;
+        idx = intern(id);
+        if (!commitUpdate()) return NOT_FOUND;
+        return idx;
+    }
+
+    // Another process may have added it since we loaded.
+    idx = lookup(id);
+    if (idx != NOT_FOUND) return idx;
+
+    idx = static_cast<uint32_t>(names_.size());
+    addName(keep(id));
+    pending_.append(id.data(), id.size());
+    pending_.push_back('\n');
+    return idx;
+}
@@ -0,0 +1,97 @@
+// id_dictionary.{h,cpp}
+// -------------------------------------
+// Persistent append-only dictionary that interns validated actor and
+// person IDs to dense uint32 indexes.
+//
+// on-disk format: one validated ID per line, the line number is the index.
+// The file is only ever appended to, so an index handed out once stays
+// valid for the lifetime of the log. It is loaded with mmap and shared by
+// logappend, logread and any index built on top of the log.
+//
+// The in-memory index is a flat open-addressing table of (hash, index)
+// slots: no node per ID, and a probe compares an ID's bytes only when
+// the stored hash matches. The IDs themselves stay in the mmap, or in a
+// few large owned buffers for IDs added after loading.
+
+#ifndef ID_DICTIONARY_H
+#define ID_DICTIONARY_H
+
+#include "security_utils.h"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+inline const std::string ID_DICT_PATH = "logs/gallery.ids";
+
+class IdDictionary {
+public:
+    static constexpr uint32_t NOT_FOUND = 0xFFFFFFFFu;
+
+    IdDictionary() = default;
+    ~IdDictionary();
+    IdDictionary(const IdDictionary&) = delete;
+    IdDictionary& operator=(const IdDictionary&) = delete;
+
+    // open (creating with 0600 if needed) and mmap the dictionary file
+    bool load(const std::string& path);
+
+    // Readers: map the file as it is now, without creating it or ever
+    // taking its lock. IDs that are not in the file are interned into a
+    // local index only (the next free indexes, never written back), so a
+    // read-only dictionary must not be used to write the log.
+    bool loadReadOnly(const std::string& path);
+    bool readOnly() const { return readOnly_; }
+
+    // index of an already interned ID, or NOT_FOUND
+    uint32_t lookup(std::string_view id) const;
+
+    // index of id, appending it to the file if it is new (read-only:
+    // adding it to the local index). id must already be validated.
+    // Returns NOT_FOUND on I/O failure.
+    uint32_t intern(std::string_view id);
+
+    // Hold the dictionary lock across many intern() calls so a replay
+    // that discovers lots of new IDs writes them with a single write().
+    // If that write fails, commitUpdate() returns false and forgets every
+    // ID interned since beginUpdate(): their indexes were never written,
+    // so they will be handed out again (callers drop state keyed by them).
+    bool beginUpdate();
+    bool commitUpdate();
+
+    std::string_view name(uint32_t idx) const { return names_[idx]; }
+    size_t size() const { return names_.size(); }
+
+private:
+    // One slot of the index; idx == NOT_FOUND marks it empty.
+    struct Slot {
+        uint32_t hash = 0;
+        uint32_t idx = NOT_FOUND;
+    };
+
+    bool mapFile();                      // mmap fd_ and index its complete lines
+    bool catchUp();                      // pick up IDs appended by other processes
+    void addName(std::string_view name); // register name at the next index
+    void truncateNames(size_t count);    // forget every index >= count
+    void growIndex(size_t ids);          // rehash so `ids` IDs fit under the load limit
+    std::string_view keep(std::string_view id); // copy id into owned_
+
+    int fd_ = -1;
+    void* map_ = nullptr;
+    size_t mapLen_ = 0;
+    off_t loadedBytes_ = 0;   // bytes of the file already parsed
+    bool updating_ = false;   // inside beginUpdate()/commitUpdate()
+    size_t committedNames_ = 0; // names_ backed by the file at beginUpdate()
+    bool readOnly_ = false;   // loadReadOnly(): never writes, never locks
+    std::string pending_;     // lines buffered during an update
+    LockStats lockStats_{"dict"};
+
+    std::vector<std::string_view> names_; // index -> ID
+    std::vector<Slot> slots_;             // ID -> index, power-of-two size
+    size_t indexed_ = 0;                  // slots in use
+    std::deque<std::string> owned_; // storage for IDs not backed by the mmap
+};
+
+#endif // ID_DICTIONARY_H
@@ -0,0 +1,395 @@
+// io_backend.{h,cpp}
+// -------------------------------------
+// Pluggable I/O backend for log appends and log scans.
+//
+// responsibilities:
+// pick the backend from GALLERYLOG_IO / GALLERYLOG_IO_DEPTH
+// set up a per-thread io_uring with the raw io_uring_setup/io_uring_enter
+// syscalls and the mmap'd SQ/CQ rings
+// durable append: linked WRITE + FSYNC(DATASYNC), or write() + fdatasync()
+// chunked scan: up to queueDepth reads in flight, delivered in file order
+// fall back to the sync path whenever io_uring is missing or refuses an op
+
+#include "io_backend.h"
+#include <linux/io_uring.h>
+#include <algorithm>       // std::min, std::max
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>         // getenv, strtoul
+#include <cstring>         // memset, strcmp
+#include <memory>
+#include <vector>
+#include <sys/mman.h>      // mmap
+#include <sys/stat.h>      // fstat
+#include <sys/syscall.h>   // __NR_io_uring_*
+#include <unistd.h>        // syscall, pread, write
+
+static IoOptions loadIoOptions() {
+    IoOptions opts;
+    if (const char* env = std::getenv("GALLERYLOG_IO")) {
+        if (std::strcmp(env, "uring") == 0) opts.mode = IoMode::Uring;
+    }
+    if (const char* env = std::getenv("GALLERYLOG_IO_DEPTH")) {
+        char* end = nullptr;
+        unsigned long v = std::strtoul(env, &end, 10);
+        if (end != env && *end == '\0') opts.queueDepth = static_cast<unsigned>(std::min(v, 256ul));
+    }
+    opts.queueDepth = std::max(opts.queueDepth, 2u);
+    return opts;
+}
+
+static IoOptions& ioOptionsStorage() {
+    static IoOptions opts = loadIoOptions();
+    return opts;
+}
+
+void setIoOptions(const IoOptions& opts) {
+    ioOptionsStorage() = opts;
+    ioOptionsStorage().queueDepth = std::min(std::max(opts.queueDepth, 2u), 256u);
+}
+const IoOptions& ioOptions() { return ioOptionsStorage(); }
+
+// Minimal io_uring: one SQ/CQ pair owned by a single thread, no SQPOLL.
+class IoRing {
+public:
+    IoRing() = default;
+    ~IoRing();
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    bool init(unsigned entries);
+
+    // next SQE (zeroed), or nullptr if the SQ is full; it is handed to
+    // the kernel by the next submit()
+    io_uring_sqe* getSqe();
+    unsigned unsubmitted() const { return sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE); }
+
+    // submit queued SQEs and wait for at least waitNr completions
+    bool submit(unsigned waitNr);
+
+    // pop one completion; false if none is ready
+    bool popCqe(uint64_t& userData, int& res);
+
+private:
+    int fd_ = -1;
+    void* sqRing_ = MAP_FAILED;
+    size_t sqRingLen_ = 0;
+    void* cqRing_ = MAP_FAILED;
+    size_t cqRingLen_ = 0;
+    void* sqes_ = MAP_FAILED;
+    size_t sqesLen_ = 0;
+
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned sqeTail_ = 0; // local tail, published to *sqTail_ on submit
+
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned cqMask_ = 0;
+};
+
+IoRing::~IoRing() {
+    if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqesLen_);
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) ::munmap(cqRing_, cqRingLen_);
+    if (sqRing_ != MAP_FAILED) ::munmap(sqRing_, sqRingLen_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool IoRing::init(unsigned entries) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+    if (fd_ < 0) return false;
+
+    // offset -1 (append at the current position) needs RW_CUR_POS
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) return false;
+
+    sqRingLen_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingLen_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sqRingLen_ = cqRingLen_ = std::max(sqRingLen_, cqRingLen_);
+
+    sqRing_ = ::mmap(nullptr, sqRingLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) return false;
+    cqRing_ = single ? sqRing_
+                     : ::mmap(nullptr, cqRingLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) return false;
+    sqesLen_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = ::mmap(nullptr, sqesLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) return false;
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_    = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sqTail_    = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqArray_   = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sqMask_    = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqEntries_ = p.sq_entries;
+    sqeTail_   = *sqTail_;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqes_   = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    return true;
+}
+
+io_uring_sqe* IoRing::getSqe() {
+    const unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= sqEntries_) return nullptr;
+
+    const unsigned idx = sqeTail_ & sqMask_;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + idx;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    ++sqeTail_;
+    return sqe;
+}
+
+bool IoRing::submit(unsigned waitNr) {
+    // publish the filled SQEs before the kernel looks at the tail
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+
+    unsigned toSubmit = unsubmitted();
+    if (toSubmit == 0 && waitNr == 0) return true;
+
+    while (true) {
+        long r = ::syscall(__NR_io_uring_enter, fd_, toSubmit, waitNr,
+                           waitNr ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (r >= 0) return true;
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+        toSubmit = unsubmitted();
+    }
+}
+
+bool IoRing::popCqe(uint64_t& userData, int& res) {
+    const unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) return false;
+
+    const io_uring_cqe& cqe = cqes_[head & cqMask_];
+    userData = cqe.user_data;
+    res = cqe.res;
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// One ring per thread, set up on first use. nullptr when the sync
+// backend is selected or io_uring is unavailable / was disabled.
+static std::unique_ptr<IoRing>& ringSlot() {
+    thread_local std::unique_ptr<IoRing> ring;
+    return ring;
+}
+
+static IoRing* threadRing() {
+    thread_local bool tried = false;
+    if (ioOptions().mode != IoMode::Uring) return nullptr;
+    if (!tried) {
+        tried = true;
+        auto ring = std::make_unique<IoRing>();
+        if (ring->init(ioOptions().queueDepth)) ringSlot() = std::move(ring);
+    }
+    return ringSlot().get();
+}
+
+// The kernel rejected an opcode: stop using io_uring in this thread.
+static void disableRing() { ringSlot().reset(); }
+
+static bool unsupported(int res) { return res == -EINVAL || res == -EOPNOTSUPP; }
+
+// Wait until every request still owned by the kernel has completed, so
+// no read lands in a buffer that is about to be freed.
+static void drain(IoRing& ring, unsigned inKernel) {
+    uint64_t ud;
+    int res;
+    while (inKernel > 0) {
+        if (ring.popCqe(ud, res)) --inKernel;
+        else if (!ring.submit(1)) std::abort(); // buffers still owned by the kernel
+    }
+}
+
+// One write() per record keeps a crash down to a single torn line;
+// fdatasync makes it durable before the caller reports success.
+static bool syncAppend(int fd, const char* data, size_t len) {
+    ssize_t written = ::write(fd, data, len);
+    return written == static_cast<ssize_t>(len) && ::fdatasync(fd) == 0;
+}
+
+bool appendDurable(int fd, const char* data, size_t len) {
+    IoRing* ring = threadRing();
+    if (!ring) return syncAppend(fd, data, len);
+
+    io_uring_sqe* w = ring->getSqe();
+    io_uring_sqe* s = w ? ring->getSqe() : nullptr;
+    if (!s) return false; // cannot happen: nothing else is queued
+
+    // same single write as the sync path; the fsync only runs if the
+    // write completed in full (IOSQE_IO_LINK)
+    w->opcode    = IORING_OP_WRITE;
+    w->fd        = fd;
+    w->addr      = reinterpret_cast<uint64_t>(data);
+    w->len       = static_cast<uint32_t>(len);
+    w->off       = static_cast<uint64_t>(-1); // current position (O_APPEND)
+    w->flags     = IOSQE_IO_LINK;
+    w->user_data = 0;
+
+    s->opcode      = IORING_OP_FSYNC;
+    s->fd          = fd;
+    s->fsync_flags = IORING_FSYNC_DATASYNC;
+    s->user_data   = 1;
+
+    if (!ring->submit(2)) {
+        // nothing was handed to the kernel
+        disableRing();
+        return syncAppend(fd, data, len);
+    }
+
+    int writeRes = -ECANCELED, syncRes = -ECANCELED;
+    for (unsigned got = 0; got < 2;) {
+        uint64_t ud;
+        int res;
+        if (!ring->popCqe(ud, res)) {
+            if (!ring->submit(1)) std::abort(); // data still owned by the kernel
+            continue;
+        }
+        (ud == 0 ? writeRes : syncRes) = res;
+        ++got;
+    }
+
+    if (unsupported(writeRes)) {
+        disableRing();
+        return syncAppend(fd, data, len);
+    }
+    if (writeRes == static_cast<int>(len) && unsupported(syncRes)) {
+        disableRing();
+        return ::fdatasync(fd) == 0;
+    }
+    if (writeRes < 0) errno = -writeRes;
+    else if (syncRes < 0) errno = -syncRes;
+    return writeRes == static_cast<int>(len) && syncRes == 0;
+}
+
+static bool syncReadChunks(int fd, off_t off, off_t end, size_t chunkSize,
+                           const std::function<void(const char*, size_t)>& fn) {
+    std::vector<char> buf(chunkSize);
+    while (end < 0 || off < end) {
+        size_t want = chunkSize;
+        if (end >= 0 && static_cast<off_t>(want) > end - off) want = static_cast<size_t>(end - off);
+
+        ssize_t n = ::pread(fd, buf.data(), want, off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) break;
+        off += n;
+        fn(buf.data(), static_cast<size_t>(n));
+    }
+    return true;
+}
+
+bool readChunks(int fd, off_t start, off_t end, size_t chunkSize,
+                const std::function<void(const char*, size_t)>& fn) {
+    IoRing* ring = threadRing();
+    if (!ring) return syncReadChunks(fd, start, end, chunkSize, fn);
+
+    if (end < 0) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) return false;
+        end = st.st_size;
+    }
+
+    // Chunk n always uses slot n % depth, so slots complete in any order
+    // but are handed to fn strictly in file order.
+    struct Slot {
+        std::vector<char> buf;
+        off_t off = 0;
+        size_t len = 0;
+        int res = 0;
+        bool done = false;
+    };
+    const unsigned depth = ioOptions().queueDepth;
+    std::vector<Slot> slots(depth);
+    off_t nextOff = start;  // next chunk to queue
+    unsigned inKernel = 0;  // queued, not completed
+    unsigned pending = 0;   // queued, not delivered
+
+    auto queue = [&](size_t idx) {
+        Slot& sl = slots[idx];
+        sl.buf.resize(chunkSize);
+        sl.off = nextOff;
+        sl.len = static_cast<size_t>(std::min<off_t>(static_cast<off_t>(chunkSize), end - nextOff));
+        sl.done = false;
+
+        io_uring_sqe* sqe = ring->getSqe(); // never full: at most depth reads in flight
+        sqe->opcode    = IORING_OP_READ;
+        sqe->fd        = fd;
+        sqe->addr      = reinterpret_cast<uint64_t>(sl.buf.data());
+        sqe->len       = static_cast<uint32_t>(sl.len);
+        sqe->off       = static_cast<uint64_t>(sl.off);
+        sqe->user_data = idx;
+
+        nextOff += static_cast<off_t>(sl.len);
+        ++inKernel;
+        ++pending;
+    };
+
+    for (size_t i = 0; i < depth && nextOff < end; ++i) queue(i);
+
+    for (size_t head = 0; pending > 0; head = (head + 1) % depth) {
+        Slot& sl = slots[head];
+        while (!sl.done) {
+            uint64_t ud;
+            int res;
+            if (ring->popCqe(ud, res)) {
+                slots[ud].res = res;
+                slots[ud].done = true;
+                --inKernel;
+            } else if (!ring->submit(1)) {
+                if (inKernel == ring->unsubmitted()) {
+                    // nothing reached the kernel yet
+                    disableRing();
+                    return syncReadChunks(fd, sl.off, end, chunkSize, fn);
+                }
+                std::abort(); // buffers still owned by the kernel
+            }
+        }
+        --pending;
+
+        if (sl.res < 0) {
+            drain(*ring, inKernel);
+            if (unsupported(sl.res)) {
+                disableRing();
+                return syncReadChunks(fd, sl.off, end, chunkSize, fn);
+            }
+            errno = -sl.res;
+            return false;
+        }
+
+        if (static_cast<size_t>(sl.res) < sl.len) {
+            // Short read (e.g. the file shrank): deliver what we got and
+            // finish the range with plain preads, which stop at EOF.
+            drain(*ring, inKernel);
+            if (sl.res > 0) fn(sl.buf.data(), static_cast<size_t>(sl.res));
+            if (sl.res == 0) return true;
+            return syncReadChunks(fd, sl.off + sl.res, end, chunkSize, fn);
+        }
+
+        fn(sl.buf.data(), sl.len);
+
+        // Reuse the slot for the next chunk; refills are submitted in
+        // batches so the kernel always has reads queued while fn parses.
+        if (nextOff < end) {
+            queue(head);
+            // a failed submit is retried by the next wait
+            if (ring->unsubmitted() >= std::max(1u, depth / 2)) (void)ring->submit(0);
+        }
+    }
+    return true;
+}
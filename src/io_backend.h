@@ -0,0 +1,43 @@
+// io_backend.{h,cpp}
+// -------------------------------------
+// Pluggable I/O backend for log appends and log scans.
+//
+// sync  : plain write() + fdatasync() and pread() (the default)
+// uring : io_uring driven through the raw syscalls (no liburing needed)
+//           - an append is a linked WRITE -> FSYNC(DATASYNC) pair, sent
+//             with one io_uring_enter() instead of two syscalls
+//           - a scan keeps up to queueDepth chunk reads in flight, so the
+//             parser works on one chunk while the next ones are read
+//
+// The backend is chosen once per process from GALLERYLOG_IO=sync|uring
+// and GALLERYLOG_IO_DEPTH (reads in flight, default 8). If io_uring is
+// not available (old kernel, seccomp, ...) every call quietly falls back
+// to the sync path, so results never depend on the backend.
+
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <cstddef>
+#include <functional>
+#include <sys/types.h>
+
+enum class IoMode { Sync, Uring };
+
+struct IoOptions {
+    IoMode mode = IoMode::Sync;
+    unsigned queueDepth = 8; // 2..256
+};
+void setIoOptions(const IoOptions& opts);
+const IoOptions& ioOptions();
+
+// Append len bytes with a single write and make them durable
+// (fdatasync). fd must be opened O_APPEND. Returns false on error.
+bool appendDurable(int fd, const char* data, size_t len);
+
+// Read [start, end) of fd in chunks of chunkSize and hand each chunk to fn
+// in file order. end < 0 means up to the file size when the scan starts
+// (sync: up to EOF). Returns false on a read error.
+bool readChunks(int fd, off_t start, off_t end, size_t chunkSize,
+                const std::function<void(const char*, size_t)>& fn);
+
+#endif // IO_BACKEND_H
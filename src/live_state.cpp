@@ -0,0 +1,327 @@
+// live_state.{h,cpp}
+// -------------------------------------
+// Seqlock-published live state table in shared memory.
+//
+// responsibilities:
+// create / attach the /dev/shm segment (0600, owned by us)
+// serialize writers with an OFD lock on the segment; readers never lock
+// publish one segment's state: incrementally when the table is current,
+// otherwise every person that hashes to the segment
+// reset segment marks when the layout changes or a writer died mid-update
+// lock-free, retrying reads: one room count, one person, segment marks,
+// whole snapshot
+
+#include "live_state.h"
+#include <algorithm>       // std::min, std::max
+#include <atomic>
+#include <cstddef>         // offsetof
+#include <cstring>         // memset
+#include <mutex>
+#include <sched.h>         // sched_yield
+#include <sys/mman.h>      // shm_open, mmap
+#include <sys/stat.h>      // fstat
+#include <fcntl.h>         // O_* flags
+#include <unistd.h>        // ftruncate, close, geteuid
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<uint8_t>::is_always_lock_free,
+              "seqlock fields must be lock-free to live in shared memory");
+
+static constexpr uint64_t STATE_MAGIC = 0x474c4f4753544154ull; // "GLOGSTAT"
+static constexpr unsigned READ_ATTEMPTS = 10000;               // then give up on a stuck writer
+
+struct LiveStateTable::Shared {
+    std::atomic<uint64_t> magic;  // set last, once the segment is initialized
+    uint32_t capacity;
+    uint32_t headerSize;
+    alignas(64) std::atomic<uint64_t> seq; // odd while a writer is updating
+    std::atomic<uint32_t> shards;          // layout covered (0 = unsharded)
+    std::atomic<uint32_t> used;            // slots [used, capacity) are all 0
+    std::atomic<uint32_t> overflow;        // an ID index did not fit
+    std::atomic<uint32_t> roomCount[LIVE_ROOM_COUNT];
+    std::atomic<uint64_t> segInode[MAX_SHARDS];
+    std::atomic<int64_t> segEnd[MAX_SHARDS];
+    alignas(64) std::atomic<uint8_t> slots[LIVE_STATE_CAPACITY];
+};
+
+static unsigned segmentCount(unsigned shards) { return shards ? shards : 1; }
+
+LiveStateTable::~LiveStateTable() {
+    if (shared_) ::munmap(shared_, sizeof(Shared));
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool LiveStateTable::map(int fd, bool writable) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_uid != ::geteuid() || (st.st_mode & 077) != 0) return false;
+
+    if (writable && st.st_size != static_cast<off_t>(sizeof(Shared)) &&
+        ::ftruncate(fd, sizeof(Shared)) != 0) {
+        return false;
+    }
+    if (!writable && st.st_size != static_cast<off_t>(sizeof(Shared))) return false;
+
+    void* p = ::mmap(nullptr, sizeof(Shared), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                     MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return false;
+    shared_ = static_cast<Shared*>(p);
+
+    if (shared_->magic.load(std::memory_order_acquire) == STATE_MAGIC &&
+        shared_->capacity == LIVE_STATE_CAPACITY && shared_->headerSize == offsetof(Shared, slots)) {
+        return true;
+    }
+    if (writable) {
+        // Fresh or foreign segment; the caller holds the writer lock.
+        std::memset(static_cast<void*>(shared_), 0, sizeof(Shared));
+        shared_->capacity = LIVE_STATE_CAPACITY;
+        shared_->headerSize = offsetof(Shared, slots);
+        shared_->magic.store(STATE_MAGIC, std::memory_order_release);
+        return true;
+    }
+    ::munmap(shared_, sizeof(Shared));
+    shared_ = nullptr;
+    return false;
+}
+
+bool LiveStateTable::create(const std::string& name) {
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+
+    // Initialization races with other writers; do it under the writer lock.
+    if (!lockFile(fd, true, &lockStats_)) {
+        ::close(fd);
+        return false;
+    }
+    bool ok = map(fd, true);
+    unlockFile(fd, &lockStats_);
+    if (!ok) {
+        ::close(fd);
+        return false;
+    }
+    fd_ = fd;
+    return true;
+}
+
+bool LiveStateTable::attach(const std::string& name) {
+    int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return false;
+    bool ok = map(fd, false);
+    ::close(fd); // the mapping stays valid
+    return ok;
+}
+
+// Runs read() until it saw a stable, even sequence number. read() must
+// only do relaxed loads; its result is discarded when it raced a writer.
+template <typename Fn>
+static bool seqRead(const std::atomic<uint64_t>& seq, Fn&& read) {
+    for (unsigned attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+        const uint64_t before = seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            if (attempt >= 64) ::sched_yield(); // writer preempted mid-update
+            continue;
+        }
+        if (!read()) return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == before) return true;
+    }
+    return false;
+}
+
+// Every segment of the covered layout published and no index dropped.
+bool LiveStateTable::complete(const Shared* s) {
+    if (s->overflow.load(std::memory_order_relaxed)) return false;
+    const unsigned n = segmentCount(s->shards.load(std::memory_order_relaxed));
+    if (n > MAX_SHARDS) return false;
+    for (unsigned k = 0; k < n; ++k) {
+        if (s->segInode[k].load(std::memory_order_relaxed) == 0) return false;
+    }
+    return true;
+}
+
+bool LiveStateTable::occupancy(Room room, uint32_t& count) const {
+    if (!shared_ || static_cast<size_t>(room) >= LIVE_ROOM_COUNT) return false;
+    bool ok = false;
+    if (!seqRead(shared_->seq, [&] {
+            ok = complete(shared_);
+            count = shared_->roomCount[static_cast<size_t>(room)].load(std::memory_order_relaxed);
+            return true;
+        })) {
+        return false;
+    }
+    return ok;
+}
+
+bool LiveStateTable::roomOf(uint32_t personIdx, Room& room) const {
+    if (!shared_ || personIdx >= LIVE_STATE_CAPACITY) return false;
+    bool ok = false;
+    uint8_t v = 0;
+    if (!seqRead(shared_->seq, [&] {
+            ok = complete(shared_);
+            v = shared_->slots[personIdx].load(std::memory_order_relaxed);
+            return true;
+        })) {
+        return false;
+    }
+    if (!ok || v > LIVE_ROOM_COUNT) return false;
+    room = v ? static_cast<Room>(v - 1) : Room::None;
+    return true;
+}
+
+// Reader side of marks() and snapshot(); runs inside seqRead.
+void LiveStateTable::readMarks(const Shared* s, LiveSnapshot& out) {
+    out.shards = s->shards.load(std::memory_order_relaxed);
+    out.segments.resize(segmentCount(out.shards));
+    for (size_t k = 0; k < out.segments.size(); ++k) {
+        out.segments[k].inode = s->segInode[k].load(std::memory_order_relaxed);
+        out.segments[k].end = s->segEnd[k].load(std::memory_order_relaxed);
+    }
+}
+
+bool LiveStateTable::marks(LiveSnapshot& out) const {
+    if (!shared_) return false;
+    bool ok = false;
+    if (!seqRead(shared_->seq, [&] {
+            ok = complete(shared_);
+            if (ok) readMarks(shared_, out);
+            return true;
+        })) {
+        return false;
+    }
+    return ok;
+}
+
+bool LiveStateTable::snapshot(LiveSnapshot& out) const {
+    if (!shared_) return false;
+    bool ok = false;
+    if (!seqRead(shared_->seq, [&] {
+            ok = complete(shared_);
+            if (!ok) return true;
+            readMarks(shared_, out);
+            for (size_t r = 0; r < LIVE_ROOM_COUNT; ++r) {
+                out.roomCount[r] = shared_->roomCount[r].load(std::memory_order_relaxed);
+            }
+            const uint32_t used = std::min(shared_->used.load(std::memory_order_relaxed),
+                                           LIVE_STATE_CAPACITY);
+            out.rooms.resize(used);
+            for (uint32_t i = 0; i < used; ++i) {
+                out.rooms[i] = shared_->slots[i].load(std::memory_order_relaxed);
+            }
+            return true;
+        })) {
+        return false;
+    }
+    return ok;
+}
+
+// Writer only (seq is odd): set one slot, keeping the room counts right.
+void LiveStateTable::setSlot(Shared* s, uint32_t idx, const StateTable& state) {
+    if (idx >= LIVE_STATE_CAPACITY) {
+        if (idx < state.size() && state[idx].inside()) s->overflow.store(1, std::memory_order_relaxed);
+        return;
+    }
+    uint8_t v = 0;
+    if (idx < state.size() && state[idx].inside() && static_cast<size_t>(state[idx].room()) < LIVE_ROOM_COUNT) {
+        v = static_cast<uint8_t>(static_cast<uint8_t>(state[idx].room()) + 1);
+    }
+    const uint8_t old = s->slots[idx].load(std::memory_order_relaxed);
+    if (old == v) return;
+    if (old) s->roomCount[old - 1].fetch_sub(1, std::memory_order_relaxed);
+    if (v) s->roomCount[v - 1].fetch_add(1, std::memory_order_relaxed);
+    s->slots[idx].store(v, std::memory_order_relaxed);
+    if (v && idx >= s->used.load(std::memory_order_relaxed)) s->used.store(idx + 1, std::memory_order_relaxed);
+}
+
+bool LiveStateTable::publish(const LogLayout& layout, unsigned segment, int fd,
+                             const IdDictionary& dict, const StateTable& state,
+                             const std::vector<uint32_t>& changed, off_t previousEnd) {
+    if (!shared_ || fd_ < 0 || segment >= segmentCount(layout.shards)) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) return false;
+
+    if (!lockFile(fd_, true, &lockStats_)) return false;
+    Shared* s = shared_;
+
+    uint64_t seq = s->seq.load(std::memory_order_relaxed);
+    const bool crashed = seq & 1; // a writer died mid-update: trust no mark
+    if (crashed) ++seq;
+    s->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (crashed || s->shards.load(std::memory_order_relaxed) != layout.shards) {
+        for (unsigned k = 0; k < MAX_SHARDS; ++k) {
+            s->segInode[k].store(0, std::memory_order_relaxed);
+            s->segEnd[k].store(0, std::memory_order_relaxed);
+        }
+        s->shards.store(layout.shards, std::memory_order_relaxed);
+    }
+
+    const bool current = s->segInode[segment].load(std::memory_order_relaxed) == st.st_ino &&
+                         s->segEnd[segment].load(std::memory_order_relaxed) == previousEnd;
+    if (current) {
+        for (uint32_t idx : changed) setSlot(s, idx, state);
+    } else {
+        // Everyone who belongs to this segment, including people that
+        // left it (their slot still says inside).
+        const size_t n = std::max(dict.size(), state.size());
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t idx = static_cast<uint32_t>(i);
+            if (layout.sharded() && (i >= dict.size() || shardFor(dict.name(idx), layout.shards) != segment)) {
+                continue;
+            }
+            setSlot(s, idx, state);
+        }
+    }
+    s->segInode[segment].store(st.st_ino, std::memory_order_relaxed);
+    s->segEnd[segment].store(st.st_size, std::memory_order_relaxed);
+
+    s->seq.store(seq + 2, std::memory_order_release);
+    unlockFile(fd_, &lockStats_);
+    return true;
+}
+
+bool LiveStateTable::publishAll(const LogLayout& layout, const std::vector<LiveSegmentMark>& marks,
+                                const StateTable& state) {
+    if (!shared_ || fd_ < 0 || marks.size() != segmentCount(layout.shards)) return false;
+    if (!lockFile(fd_, true, &lockStats_)) return false;
+    Shared* s = shared_;
+
+    uint64_t seq = s->seq.load(std::memory_order_relaxed);
+    if (seq & 1) ++seq;
+    s->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const size_t n = std::max<size_t>(state.size(), s->used.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < n; ++i) setSlot(s, static_cast<uint32_t>(i), state);
+    for (unsigned k = 0; k < MAX_SHARDS; ++k) {
+        s->segInode[k].store(k < marks.size() ? marks[k].inode : 0, std::memory_order_relaxed);
+        s->segEnd[k].store(k < marks.size() ? marks[k].end : 0, std::memory_order_relaxed);
+    }
+    s->shards.store(layout.shards, std::memory_order_relaxed);
+
+    s->seq.store(seq + 2, std::memory_order_release);
+    unlockFile(fd_, &lockStats_);
+    return true;
+}
+
+void publishLiveState(const std::string& logPath, int fd, const IdDictionary& dict,
+                      const StateTable& state, const std::vector<uint32_t>& changed,
+                      off_t previousEnd) {
+    // One table per process; GalleryLog writer threads share it (the OFD
+    // writer lock only separates processes).
+    static std::mutex mutex;
+    static LiveStateTable table;
+    std::lock_guard<std::mutex> lk(mutex);
+    static bool opened = table.create();
+    if (!opened) return;
+
+    LogLayout layout;
+    if (!loadLogLayout(layout)) return;
+    const std::vector<std::string> paths = layout.segmentPaths();
+    for (unsigned k = 0; k < paths.size(); ++k) {
+        if (paths[k] == logPath) {
+            table.publish(layout, k, fd, dict, state, changed, previousEnd);
+            return;
+        }
+    }
+}
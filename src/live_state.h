@@ -0,0 +1,107 @@
+// live_state.{h,cpp}
+// -------------------------------------
+// Current gallery state (who is inside, in which room) published by the
+// writers into shared memory, so occupancy questions need no log replay.
+//
+// The table lives in /dev/shm/gallerylog-state (0600) and holds one byte
+// per ID dictionary index (0 = not inside, otherwise room + 1) plus a
+// head count per room. Every writer (logappend, logingest, GalleryLog /
+// logd, logshard) updates it while holding the segment's append lock,
+// right after its durable write, so the table never runs ahead of the log.
+//
+// Readers never lock and never make a syscall: the table is protected by
+// a seqlock. A writer makes the sequence odd, updates bytes and counters,
+// then makes it even again; a reader copies what it needs and retries if
+// the sequence was odd or changed meanwhile. Looking up one person or one
+// room count costs a few loads.
+//
+// Each segment (the log, or one shard) records the inode and length it was
+// published at. A writer that finds a mismatch (crashed writer, logcompact,
+// torn-tail repair, a new log) republishes the whole segment from the state
+// it just replayed, so the table heals on the next append. A reader can
+// compare the same marks against the files when it must be exact.
+
+#ifndef LIVE_STATE_H
+#define LIVE_STATE_H
+
+#include "security_utils.h"
+#include "id_dictionary.h"
+#include "gallery_state.h"
+#include "log_layout.h"
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+inline const std::string LIVE_STATE_NAME = "/gallerylog-state";
+inline constexpr uint32_t LIVE_STATE_CAPACITY = 1u << 20;       // dictionary indexes covered
+inline constexpr size_t LIVE_ROOM_COUNT = std::size(ROOM_NAMES) - 1; // real rooms (no "-")
+
+// Where a segment stood when its state was last published.
+struct LiveSegmentMark {
+    uint64_t inode = 0; // 0 = never published (or reset)
+    int64_t end = 0;    // file length covered
+};
+
+// Consistent copy of the whole table.
+struct LiveSnapshot {
+    unsigned shards = 0;                    // layout it covers (0 = unsharded)
+    std::vector<LiveSegmentMark> segments;  // one per segment of that layout
+    std::vector<uint8_t> rooms;             // by dictionary index: 0 or room + 1
+    uint32_t roomCount[LIVE_ROOM_COUNT] = {};
+};
+
+class LiveStateTable {
+public:
+    LiveStateTable() = default;
+    ~LiveStateTable();
+    LiveStateTable(const LiveStateTable&) = delete;
+    LiveStateTable& operator=(const LiveStateTable&) = delete;
+
+    // writers: create the segment or attach to it read-write
+    bool create(const std::string& name = LIVE_STATE_NAME);
+    // readers: attach read-only; false if no table was published yet
+    bool attach(const std::string& name = LIVE_STATE_NAME);
+
+    // Lock-free reads. All return false if the table is incomplete (some
+    // segment never published, too many IDs) or a writer stays mid-update.
+    bool occupancy(Room room, uint32_t& count) const;
+    bool roomOf(uint32_t personIdx, Room& room) const; // Room::None = not inside
+    bool snapshot(LiveSnapshot& out) const;
+    // Only the layout and segment marks of a snapshot (shards, segments).
+    bool marks(LiveSnapshot& out) const;
+
+    // Writer side: replace the published state of one segment. state is
+    // the segment's replayed state; when the table was current at
+    // previousEnd only the `changed` indexes are rewritten, otherwise every
+    // person of the segment is. fd is the segment, append lock held.
+    bool publish(const LogLayout& layout, unsigned segment, int fd, const IdDictionary& dict,
+                 const StateTable& state, const std::vector<uint32_t>& changed, off_t previousEnd);
+
+    // Writer side: replace everything with the state of the whole log as
+    // stored in the segments described by marks (logshard switching the
+    // layout while it holds the only lock that matters).
+    bool publishAll(const LogLayout& layout, const std::vector<LiveSegmentMark>& marks,
+                    const StateTable& state);
+
+private:
+    struct Shared;
+    bool map(int fd, bool writable);
+    static bool complete(const Shared* s);
+    static void readMarks(const Shared* s, LiveSnapshot& out);
+    static void setSlot(Shared* s, uint32_t idx, const StateTable& state);
+
+    Shared* shared_ = nullptr;
+    int fd_ = -1;                      // kept by writers for the writer lock
+    LockStats lockStats_{"state"};
+};
+
+// Publishes after an append to logPath (append lock held on fd). Best
+// effort: a missing /dev/shm or a path outside the current layout only
+// means the table is not updated; the append itself already succeeded.
+void publishLiveState(const std::string& logPath, int fd, const IdDictionary& dict,
+                      const StateTable& state, const std::vector<uint32_t>& changed,
+                      off_t previousEnd);
+
+#endif // LIVE_STATE_H
@@ -0,0 +1,270 @@
+// log_client.{h,cpp}
+// -------------------------------------
+// C++20 coroutine client for logd.
+//
+// responsibilities:
+// epoll loop that drives spawned tasks
+// connect + AUTH over the Unix socket
+// buffer requests and send them in one batch per loop turn
+// match replies to requests by id and resume the awaiting coroutines
+// fail everything in flight if the connection drops
+
+#include "log_client.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Owns a spawned task until it finishes.
+struct EventLoop::Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+EventLoop::Detached EventLoop::runDetached(EventLoop* loop, Task<void> task) {
+    co_await task;
+    --loop->live_;
+}
+
+EventLoop::EventLoop() : epfd_(::epoll_create1(EPOLL_CLOEXEC)) {}
+
+EventLoop::~EventLoop() {
+    if (epfd_ >= 0) ::close(epfd_);
+}
+
+void EventLoop::spawn(Task<void> task) {
+    ++live_;
+    runDetached(this, std::move(task));
+}
+
+void EventLoop::run() {
+    epoll_event events[64];
+    stopped_ = false;
+
+    while (!stopped_ && live_ > 0) {
+        // Buffered requests go out now, one send() per connection.
+        for (size_t i = 0; i < watchers_.size(); ++i) watchers_[i]->beforeWait();
+        if (live_ == 0 || watchers_.empty()) break; // nothing could wake a task
+
+        int n = ::epoll_wait(epfd_, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            static_cast<Watcher*>(events[i].data.ptr)->onEvents(events[i].events);
+        }
+    }
+}
+
+bool EventLoop::watch(int fd, uint32_t events, Watcher* w) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = w;
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) != 0) return false;
+    watchers_.push_back(w);
+    return true;
+}
+
+void EventLoop::modify(int fd, uint32_t events, Watcher* w) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = w;
+    ::epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EventLoop::unwatch(int fd, Watcher* w) {
+    ::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+    for (size_t i = 0; i < watchers_.size(); ++i) {
+        if (watchers_[i] == w) {
+            watchers_.erase(watchers_.begin() + static_cast<long>(i));
+            break;
+        }
+    }
+}
+
+LogClient::Request::~Request() {
+    if (client_) client_->ops_.erase(id_); // a late reply is ignored
+}
+
+bool LogClient::Request::await_ready() const {
+    return client_->ops_[id_].done;
+}
+
+void LogClient::Request::await_suspend(std::coroutine_handle<> h) {
+    client_->ops_[id_].waiter = h;
+}
+
+LogReply LogClient::Request::await_resume() {
+    auto it = client_->ops_.find(id_);
+    LogReply reply = std::move(it->second.reply);
+    client_->ops_.erase(it);
+    client_ = nullptr;
+    return reply;
+}
+
+LogClient::~LogClient() {
+    if (fd_ >= 0) {
+        loop_.unwatch(fd_, this);
+        ::close(fd_);
+    }
+}
+
+Task<std::string> LogClient::connect(std::string token, std::string socketPath) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (fd_ >= 0) co_return "already connected";
+    if (socketPath.size() >= sizeof(addr.sun_path)) co_return "socket path too long";
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    // A local connect completes (or fails) immediately.
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) co_return "failed to create socket";
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::fcntl(fd, F_SETFL, O_NONBLOCK) != 0 ||
+        !loop_.watch(fd, EPOLLIN | EPOLLRDHUP, this)) {
+        ::close(fd);
+        co_return "failed to connect to log service";
+    }
+    fd_ = fd;
+
+    const uint64_t id = nextId_++;
+    formatAuthRequest(out_, id, token);
+    LogReply reply = co_await start(id);
+    co_return reply.error;
+}
+
+LogClient::Request LogClient::start(uint64_t id) {
+    Op& op = ops_[id];
+    if (fd_ < 0) {
+        op.reply.error = "not connected";
+        op.done = true;
+    }
+    return Request(this, id);
+}
+
+LogClient::Request LogClient::append(std::string_view personId, Action action, Room room) {
+    const uint64_t id = nextId_++;
+    if (fd_ >= 0) formatAppendRequest(out_, id, personId, action, room);
+    return start(id);
+}
+
+LogClient::Request LogClient::query(std::string_view personId) {
+    const uint64_t id = nextId_++;
+    if (fd_ >= 0) formatQueryRequest(out_, id, personId);
+    return start(id);
+}
+
+void LogClient::beforeWait() {
+    if (fd_ >= 0 && !out_.empty() && !flushOut()) disconnect("connection to log service lost");
+}
+
+// Sends as much of out_ as the socket takes; the rest waits for EPOLLOUT.
+bool LogClient::flushOut() {
+    size_t done = 0;
+    while (done < out_.size()) {
+        ssize_t n = ::send(fd_, out_.data() + done, out_.size() - done, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    out_.erase(0, done);
+
+    const bool want = !out_.empty();
+    if (want != wantWrite_) {
+        loop_.modify(fd_, EPOLLIN | EPOLLRDHUP | (want ? EPOLLOUT : 0u), this);
+        wantWrite_ = want;
+    }
+    return true;
+}
+
+void LogClient::onEvents(uint32_t events) {
+    if ((events & EPOLLOUT) && !flushOut()) {
+        disconnect("connection to log service lost");
+        return;
+    }
+    if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) return;
+
+    bool closed = false;
+    char buf[64 * 1024];
+    while (true) {
+        ssize_t n = ::read(fd_, buf, sizeof(buf));
+        if (n > 0) {
+            in_.append(buf, static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        closed = n == 0 || errno != EAGAIN;
+        break;
+    }
+
+    // Complete requests first, resume their coroutines afterwards, so a
+    // resumed task that issues new requests never sees a half-parsed buffer.
+    std::vector<std::coroutine_handle<>> ready;
+    size_t start = 0;
+    for (size_t nl = in_.find('\n'); nl != std::string::npos; nl = in_.find('\n', start)) {
+        std::string_view line(in_.data() + start, nl - start);
+        start = nl + 1;
+
+        LogdResponse r;
+        if (!parseLogdResponse(line, r)) continue;
+        if (r.id == LOGD_NOTICE_ID) {
+            // not an answer: the reason the server is about to close
+            if (r.kind == LogdReply::Err && !r.text.empty()) notice_ = std::string(r.text);
+            continue;
+        }
+        auto it = ops_.find(r.id);
+        if (it == ops_.end()) continue; // abandoned request
+        Op& op = it->second;
+
+        if (r.kind == LogdReply::Entry) {
+            LogEntry e;
+            if (parseLogLine(r.text, e)) op.reply.entries.push_back(std::move(e));
+            continue;
+        }
+        if (r.kind == LogdReply::Err) op.reply.error = r.text.empty() ? "request failed" : std::string(r.text);
+        op.done = true;
+        if (op.waiter) ready.push_back(op.waiter);
+    }
+    in_.erase(0, start);
+
+    if (closed) {
+        disconnect(notice_.empty() ? "connection to log service lost" : "log service: " + notice_);
+        return; // disconnect resumed everything still waiting
+    }
+    for (auto h : ready) h.resume();
+}
+
+void LogClient::disconnect(const std::string& why) {
+    if (fd_ >= 0) {
+        loop_.unwatch(fd_, this);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    out_.clear();
+    in_.clear();
+
+    std::vector<std::coroutine_handle<>> ready;
+    for (auto& [id, op] : ops_) {
+        if (op.done) {
+            if (op.waiter) ready.push_back(op.waiter);
+            continue;
+        }
+        op.reply.error = why;
+        op.done = true;
+        if (op.waiter) ready.push_back(op.waiter);
+    }
+    for (auto h : ready) h.resume();
+}
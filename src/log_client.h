@@ -0,0 +1,222 @@
+// log_client.{h,cpp}
+// -------------------------------------
+// C++20 coroutine client for logd (see logd.cpp, log_protocol.h).
+//
+//   EventLoop loop;
+//   LogClient log(loop);
+//   loop.spawn([&]() -> Task<void> {
+//       if (!(co_await log.connect(token)).empty()) co_return;
+//       LogReply r = co_await log.append("emp001", Action::Enter, Room::Lobby);
+//   }());
+//   loop.run();
+//
+// Everything runs on the thread that calls loop.run(): one epoll loop, no
+// locks and no thread switches. A request is written to the connection's
+// buffer when it is created and every buffered request goes out with one
+// send() before the loop waits, so thousands of coroutines awaiting
+// append() share a handful of syscalls and any number of requests can be
+// in flight (pipelined) on one connection. Replies are matched by id.
+//
+// Build with -std=c++20; the rest of the tree only needs C++17.
+
+#ifndef LOG_CLIENT_H
+#define LOG_CLIENT_H
+
+#include "security_utils.h"
+#include "log_protocol.h"
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template <typename T> class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation; // resumed when the task finishes
+
+    std::suspend_always initial_suspend() noexcept { return {}; } // lazy
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            auto next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); } // the tree does not use exceptions
+};
+
+template <typename T>
+struct TaskPromise : PromiseBase {
+    std::optional<T> value;
+    Task<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+    T result() { return std::move(*value); }
+};
+
+template <>
+struct TaskPromise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {}
+};
+
+} // namespace detail
+
+// Lazily started coroutine producing T. co_await starts it, and the
+// awaiting coroutine continues (symmetric transfer) when it finishes.
+template <typename T = void>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle h) : h_(h) {}
+    Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task& operator=(Task&& o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (h_) h_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        h_.promise().continuation = awaiting;
+        return h_;
+    }
+    T await_resume() { return h_.promise().result(); }
+
+private:
+    Handle h_;
+};
+
+namespace detail {
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+} // namespace detail
+
+// Single-threaded epoll loop that drives every spawned task.
+class EventLoop {
+public:
+    // Something with a file descriptor in the loop (LogClient).
+    class Watcher {
+    public:
+        virtual ~Watcher() = default;
+        virtual void onEvents(uint32_t events) = 0;
+        virtual void beforeWait() {} // last chance to flush before epoll_wait
+    };
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool ok() const { return epfd_ >= 0; }
+
+    // Start task now; it runs until its first suspension. The loop keeps
+    // running while any spawned task is unfinished.
+    void spawn(Task<void> task);
+
+    // Runs until every spawned task has finished, or stop() is called.
+    void run();
+    void stop() { stopped_ = true; }
+
+    bool watch(int fd, uint32_t events, Watcher* w);
+    void modify(int fd, uint32_t events, Watcher* w);
+    void unwatch(int fd, Watcher* w);
+
+private:
+    struct Detached;
+    static Detached runDetached(EventLoop* loop, Task<void> task);
+
+    int epfd_ = -1;
+    size_t live_ = 0;      // spawned tasks not finished yet
+    bool stopped_ = false;
+    std::vector<Watcher*> watchers_;
+};
+
+struct LogReply {
+    std::string error;             // empty on success, otherwise why it failed
+    std::vector<LogEntry> entries; // QUERY results
+    bool ok() const { return error.empty(); }
+};
+
+// One connection to logd. Create it, connect() once, then issue any
+// number of requests from any task on the same loop. Destroy it only
+// after run() returns or from a task, never while a request is awaited.
+class LogClient : private EventLoop::Watcher {
+public:
+    // Awaitable reply to one request (co_await gives a LogReply).
+    class Request {
+    public:
+        Request(LogClient* client, uint64_t id) : client_(client), id_(id) {}
+        Request(Request&& o) noexcept : client_(std::exchange(o.client_, nullptr)), id_(o.id_) {}
+        Request(const Request&) = delete;
+        Request& operator=(const Request&) = delete;
+        ~Request(); // a request that is never awaited is abandoned
+
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> h);
+        LogReply await_resume();
+
+    private:
+        LogClient* client_;
+        uint64_t id_;
+    };
+
+    explicit LogClient(EventLoop& loop) : loop_(loop) {}
+    ~LogClient() override;
+    LogClient(const LogClient&) = delete;
+    LogClient& operator=(const LogClient&) = delete;
+
+    // Connects and authenticates; co_await gives "" or an error message.
+    Task<std::string> connect(std::string token, std::string socketPath = LOGD_SOCKET_PATH);
+
+    Request append(std::string_view personId, Action action, Room room);
+    Request query(std::string_view personId = {}); // empty = everyone
+
+    size_t inFlight() const { return ops_.size(); }
+
+private:
+    struct Op {
+        LogReply reply;
+        bool done = false;
+        std::coroutine_handle<> waiter;
+    };
+
+    Request start(uint64_t id); // op registered, request already buffered
+    void onEvents(uint32_t events) override;
+    void beforeWait() override;
+    bool flushOut();
+    void disconnect(const std::string& why); // fails every request in flight
+
+    EventLoop& loop_;
+    int fd_ = -1;
+    bool wantWrite_ = false;
+    uint64_t nextId_ = 1;
+    std::string in_;
+    std::string out_;
+    std::string notice_; // last LOGD_NOTICE_ID error, reported on close
+    std::unordered_map<uint64_t, Op> ops_;
+};
+
+#endif // LOG_CLIENT_H
@@ -0,0 +1,71 @@
+// log_layout.{h,cpp}
+// -------------------------------------
+// Optional hash-sharded log layout.
+//
+// responsibilities:
+// read the shard manifest
+// map a person ID to its shard with a stable hash
+// list the active segments for readers and maintenance tools
+
+#include "log_layout.h"
+#include "security_utils.h"
+#include <cerrno>
+#include <charconv>        // std::from_chars
+#include <fcntl.h>
+#include <unistd.h>
+
+// FNV-1a: stable across builds and platforms, unlike std::hash, so a
+// person always lands in the same shard.
+unsigned shardFor(std::string_view personId, unsigned shards) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : personId) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h % shards;
+}
+
+std::string shardPath(unsigned shard) {
+    return "logs/gallery." + std::to_string(shard) + ".log";
+}
+
+std::string LogLayout::pathFor(std::string_view personId) const {
+    return sharded() ? shardPath(shardFor(personId, shards)) : LOG_FILE_PATH;
+}
+
+std::vector<std::string> LogLayout::segmentPaths() const {
+    std::vector<std::string> paths;
+    if (!sharded()) {
+        paths.push_back(LOG_FILE_PATH);
+        return paths;
+    }
+    for (unsigned k = 0; k < shards; ++k) paths.push_back(shardPath(k));
+    return paths;
+}
+
+bool loadLogLayout(LogLayout& out) {
+    out.shards = 0;
+
+    int fd = ::open(SHARD_MANIFEST_PATH.c_str(), O_RDONLY);
+    if (fd < 0) return errno == ENOENT; // no manifest -> single log file
+
+    char buf[64];
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    ::close(fd);
+    if (n <= 0) return false;
+
+    std::string_view s(buf, static_cast<size_t>(n));
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.remove_suffix(1);
+
+    constexpr std::string_view KEY = "shards=";
+    if (s.substr(0, KEY.size()) != KEY) return false;
+    s.remove_prefix(KEY.size());
+
+    unsigned shards = 0;
+    auto res = std::from_chars(s.data(), s.data() + s.size(), shards);
+    if (res.ec != std::errc() || res.ptr != s.data() + s.size()) return false;
+    if (shards == 0 || shards > MAX_SHARDS) return false;
+
+    out.shards = shards;
+    return true;
+}
@@ -0,0 +1,38 @@
+// log_layout.{h,cpp}
+// -------------------------------------
+// Optional hash-sharded log layout.
+//
+// Without a manifest the log is the single file logs/gallery.log.
+// logshard switches to N shard files chosen by hash(personId):
+//   logs/gallery.manifest      "shards=<N>"
+//   logs/gallery.<k>.log       k = fnv1a(personId) % N
+// Gallery rules only look at one person, so every shard has its own lock,
+// its own replayed state and its own checkpoints; appends to different
+// shards never contend. The ID dictionary stays shared.
+
+#ifndef LOG_LAYOUT_H
+#define LOG_LAYOUT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+inline const std::string SHARD_MANIFEST_PATH = "logs/gallery.manifest";
+inline constexpr unsigned MAX_SHARDS = 256;
+
+struct LogLayout {
+    unsigned shards = 0; // 0 = unsharded (LOG_FILE_PATH)
+
+    bool sharded() const { return shards > 0; }
+    std::string pathFor(std::string_view personId) const; // segment holding this person
+    std::vector<std::string> segmentPaths() const;        // every active segment
+};
+
+// Reads the manifest. A missing manifest means unsharded.
+// Returns false if the manifest exists but cannot be read or is invalid.
+bool loadLogLayout(LogLayout& out);
+
+std::string shardPath(unsigned shard);
+unsigned shardFor(std::string_view personId, unsigned shards);
+
+#endif // LOG_LAYOUT_H
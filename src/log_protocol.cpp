@@ -0,0 +1,119 @@
+// log_protocol.{h,cpp}
+// -------------------------------------
+// Line protocol between logd and its clients.
+//
+// responsibilities:
+// split request/response lines into id, verb and arguments
+// validate every field with the same rules as the log itself
+// format requests and responses
+
+#include "log_protocol.h"
+#include <charconv>        // std::from_chars, std::to_chars
+
+// Next space separated word of s (s advances past it).
+static std::string_view nextWord(std::string_view& s) {
+    size_t sp = s.find(' ');
+    std::string_view w = s.substr(0, sp);
+    s = (sp == std::string_view::npos) ? std::string_view() : s.substr(sp + 1);
+    return w;
+}
+
+static bool parseId(std::string_view w, uint64_t& id) {
+    if (w.empty()) return false;
+    auto res = std::from_chars(w.data(), w.data() + w.size(), id);
+    return res.ec == std::errc() && res.ptr == w.data() + w.size();
+}
+
+static void appendId(std::string& out, uint64_t id) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), id);
+    out.append(buf, static_cast<size_t>(res.ptr - buf));
+}
+
+bool parseLogdRequest(std::string_view line, LogdRequest& out) {
+    if (line.size() > LOGD_MAX_LINE) return false;
+    if (!parseId(nextWord(line), out.id) || out.id == LOGD_NOTICE_ID) return false;
+
+    std::string_view verb = nextWord(line);
+    if (verb == "AUTH") {
+        out.verb = LogdVerb::Auth;
+        out.token = line;
+        return !line.empty();
+    }
+    if (verb == "APPEND") {
+        out.verb = LogdVerb::Append;
+        out.personId = nextWord(line);
+        std::string_view action = nextWord(line);
+        std::string_view room = nextWord(line);
+        return line.empty() && validatePersonId(out.personId) &&
+               parseAction(action, out.action) && parseRoom(room, out.room);
+    }
+    if (verb == "QUERY") {
+        out.verb = LogdVerb::Query;
+        out.personId = nextWord(line);
+        if (!line.empty()) return false;
+        if (out.personId == "*") {
+            out.personId = std::string_view();
+            return true;
+        }
+        return validatePersonId(out.personId);
+    }
+    return false;
+}
+
+bool parseLogdResponse(std::string_view line, LogdResponse& out) {
+    if (!parseId(nextWord(line), out.id)) return false;
+
+    std::string_view kind = nextWord(line);
+    out.text = line;
+    if (kind == "OK") {
+        out.kind = LogdReply::Ok;
+        return line.empty();
+    }
+    if (kind == "ERR") {
+        out.kind = LogdReply::Err;
+        return true;
+    }
+    if (kind == "ENTRY") {
+        out.kind = LogdReply::Entry;
+        return !line.empty();
+    }
+    return false;
+}
+
+void formatAuthRequest(std::string& out, uint64_t id, std::string_view token) {
+    appendId(out, id);
+    out.append(" AUTH ");
+    out.append(token);
+    out.push_back('\n');
+}
+
+void formatAppendRequest(std::string& out, uint64_t id, std::string_view personId,
+                         Action action, Room room) {
+    appendId(out, id);
+    out.append(" APPEND ");
+    out.append(personId);
+    out.push_back(' ');
+    out.append(actionName(action));
+    out.push_back(' ');
+    out.append(roomName(room));
+    out.push_back('\n');
+}
+
+void formatQueryRequest(std::string& out, uint64_t id, std::string_view personId) {
+    appendId(out, id);
+    out.append(" QUERY ");
+    if (personId.empty()) out.push_back('*');
+    else out.append(personId);
+    out.push_back('\n');
+}
+
+void formatLogdResponse(std::string& out, uint64_t id, LogdReply kind, std::string_view text) {
+    appendId(out, id);
+    switch (kind) {
+    case LogdReply::Ok:    out.append(" OK"); break;
+    case LogdReply::Err:   out.append(" ERR "); out.append(text); break;
+    case LogdReply::Entry: out.append(" ENTRY "); out.append(text); break;
+    }
+    out.push_back('\n');
+}
@@ -0,0 +1,67 @@
+// log_protocol.{h,cpp}
+// -------------------------------------
+// Line protocol between logd and its clients (see logd.cpp, log_client.h).
+//
+// One message per '\n'-terminated line. Every request carries a client
+// chosen id that its response repeats, so a client can pipeline any
+// number of requests on one connection and match replies in any order.
+//
+// requests:
+//   <id> AUTH <token>                               first request, once
+//   <id> APPEND <personId> <ENTER|MOVE|EXIT> <room|->
+//   <id> QUERY <personId|*>
+// responses:
+//   <id> ENTRY <timestamp|actorId|personId|action|roomId>   (QUERY, 0..n)
+//   <id> OK                                        request done
+//   <id> ERR <message>                             request failed / rejected
+//
+// Id 0 (LOGD_NOTICE_ID) never names a request: clients number requests
+// from 1, and the server answers with id 0 only for what it cannot tie to
+// one, i.e. a line it could not parse an id from, or "0 ERR token revoked"
+// just before closing a connection whose token was rotated out.
+// A QUERY's ENTRY lines may arrive in several writes; only its OK or ERR
+// ends it.
+
+#ifndef LOG_PROTOCOL_H
+#define LOG_PROTOCOL_H
+
+#include "security_utils.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+inline const std::string LOGD_SOCKET_PATH = "logs/gallerylog.sock";
+inline constexpr size_t LOGD_MAX_LINE = 4096;
+inline constexpr uint64_t LOGD_NOTICE_ID = 0;
+
+enum class LogdVerb { Auth, Append, Query };
+
+struct LogdRequest {
+    uint64_t id = 0;
+    LogdVerb verb = LogdVerb::Auth;
+    std::string_view token;    // AUTH
+    std::string_view personId; // APPEND, QUERY (empty = everyone)
+    Action action = Action::Enter;
+    Room room = Room::None;
+};
+
+enum class LogdReply { Ok, Err, Entry };
+
+struct LogdResponse {
+    uint64_t id = 0;
+    LogdReply kind = LogdReply::Ok;
+    std::string_view text; // ERR message or ENTRY log line
+};
+
+// Parsing never trusts the peer: false on any malformed line.
+bool parseLogdRequest(std::string_view line, LogdRequest& out);
+bool parseLogdResponse(std::string_view line, LogdResponse& out);
+
+// Formatting appends one complete line (with '\n') to out.
+void formatAuthRequest(std::string& out, uint64_t id, std::string_view token);
+void formatAppendRequest(std::string& out, uint64_t id, std::string_view personId,
+                         Action action, Room room);
+void formatQueryRequest(std::string& out, uint64_t id, std::string_view personId);
+void formatLogdResponse(std::string& out, uint64_t id, LogdReply kind, std::string_view text = {});
+
+#endif // LOG_PROTOCOL_H
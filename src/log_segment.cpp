@@ -0,0 +1,342 @@
+// log_segment.{h,cpp}
+// -------------------------------------
+// Reading and appending one log segment (the log, or one shard).
+//
+// responsibilities:
+// snapshot reads: committed length under a brief shared lock, then a
+// range lock on [0, committed) while scanning
+// parse large segments in line-aligned chunks on the shared thread pool,
+// each into its own arena-backed entry batch
+// merge shard entry lists by timestamp
+// incremental, read-only replay for long-running readers
+// batched, rule-checked appends under the exclusive append-region lock,
+// published to the live state table before the lock is released
+
+#include "log_segment.h"
+#include "entry_batch.h"
+#include "io_backend.h"
+#include "thread_pool.h"
+#include "live_state.h"
+#include <algorithm>
+#include <queue>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Opens logPath read-only and share-locks its append region, reopening if
+// logcompact swapped in a new segment meanwhile. Returns the fd, -1 if
+// the file does not exist, or -2 on failure (error set).
+static int openCommitted(const std::string& logPath, LockStats& commitLock, std::string& error) {
+    while (true) {
+        int fd = openFileRO(logPath);
+        if (fd < 0) {
+            if (errno == ENOENT) return -1;
+            error = "failed to open log file for reading";
+            return -2;
+        }
+
+        // waits only for an append in progress
+        if (!lockAppendRegion(fd, false, &commitLock)) {
+            error = errno == ETIMEDOUT ? "timed out waiting for read lock on log file"
+                                       : "failed to acquire shared read lock on log file";
+            ::close(fd);
+            return -2;
+        }
+
+        if (isCurrentFile(fd, logPath)) return fd;
+        unlockAppendRegion(fd, &commitLock);
+        ::close(fd);
+    }
+}
+
+// Bytes of a segment parsed by one pool task.
+static constexpr off_t PARSE_CHUNK = 4 << 20;
+
+// What one chunk of a segment contributed.
+struct ParsedChunk {
+    bool ok = true;
+    EntryBatch entries;
+    bool sawCheckpoint = false;  // a checkpoint header starts in this chunk
+    int64_t ckptTimestamp = 0;   // of the last such header
+    std::vector<std::pair<GalleryId, Room>> inside; // state lines after it
+};
+
+// Splits [0, end) into ranges of about PARSE_CHUNK that start on a line.
+static bool chunkBounds(int fd, off_t end, std::vector<off_t>& bounds) {
+    bounds.assign(1, 0);
+    char buf[512];
+    for (off_t target = PARSE_CHUNK; target < end; target += PARSE_CHUNK) {
+        // the first line start at or after target
+        off_t pos = std::max(target - 1, bounds.back());
+        off_t next = end;
+        while (pos < end) {
+            ssize_t n = ::pread(fd, buf, static_cast<size_t>(std::min<off_t>(sizeof(buf), end - pos)), pos);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            const char* nl = static_cast<const char*>(std::memchr(buf, '\n', static_cast<size_t>(n)));
+            if (nl) {
+                next = pos + (nl - buf) + 1;
+                break;
+            }
+            pos += n;
+        }
+        if (next >= end) break;
+        if (next > bounds.back()) bounds.push_back(next);
+        target = std::max(target, next);
+    }
+    bounds.push_back(end);
+    return true;
+}
+
+static void parseChunk(int fd, off_t begin, off_t end, ParsedChunk& out) {
+    out.ok = forEachLine(fd, begin, end, [&](std::string_view line, const LineMasks& masks) {
+        LogEntry e;
+        GalleryId personId;
+        size_t count;
+        Room room;
+        if (parseLogLine(line, masks, e)) {
+            out.entries.push_back(e);
+        } else if (parseCheckpointHeader(line, out.ckptTimestamp, count)) {
+            out.sawCheckpoint = true;
+            out.inside.clear();
+        } else if (parseCheckpointState(line, personId, room)) {
+            out.inside.emplace_back(personId, room);
+        } else {
+            // Malformed lines are treated as untrusted and skipped.
+        }
+    });
+}
+
+bool readSegment(const std::string& logPath, SegmentData& seg, std::string& error) {
+    LockStats commitLock("commit"); // brief wait for an append in progress
+    LockStats scanLock("scan");     // held while reading [0, watermark)
+
+    int fd = openCommitted(logPath, commitLock, error);
+    if (fd == -1) return true; // no file yet: empty log/state
+    if (fd < 0) return false;
+    seg.found = true;
+
+    // Capture the committed length under the lock, then release it right
+    // away: the log is append-only, so everything below the watermark is
+    // immutable and writers never wait on a slow reader.
+    const off_t watermark = committedLength(fd);
+    unlockAppendRegion(fd, &commitLock);
+    if (watermark < 0) {
+        error = "failed to read log file";
+        ::close(fd);
+        return false;
+    }
+
+    // Hold a shared lock on just the scanned range; it never overlaps the
+    // append region, so writers keep going while we read.
+    if (watermark > 0 && !lockRange(fd, 0, watermark, false, &scanLock)) {
+        error = "failed to lock log range for reading";
+        ::close(fd);
+        return false;
+    }
+
+    // Parse [0, watermark) as line-aligned chunks on the shared pool and
+    // stitch the results together in file order.
+    std::vector<off_t> bounds;
+    bool readOk = chunkBounds(fd, watermark, bounds);
+    std::vector<ParsedChunk> chunks(bounds.size() - 1);
+    parallelFor(0, chunks.size(), 1, [&](size_t b, size_t e) {
+        for (size_t k = b; k < e; ++k) parseChunk(fd, bounds[k], bounds[k + 1], chunks[k]);
+    });
+
+    size_t total = 0;
+    for (const auto& c : chunks) total += c.entries.size();
+    seg.entries.reserve(total);
+    for (auto& c : chunks) {
+        readOk = readOk && c.ok;
+        c.entries.appendTo(seg.entries);
+        if (c.sawCheckpoint) {
+            seg.ckptTimestamp = c.ckptTimestamp;
+            seg.checkpoints.clear(); // only the latest checkpoint matters
+        }
+        for (const auto& [personId, room] : c.inside) {
+            seg.checkpoints.push_back(formatTimestamp(seg.ckptTimestamp) + " | " + personId.str() + " | " +
+                                      std::string(roomName(room)));
+        }
+    }
+
+    if (watermark > 0) unlockRange(fd, 0, watermark, &scanLock);
+    ::close(fd);
+
+    if (!readOk) {
+        error = "failed to read log file";
+        return false;
+    }
+    return true;
+}
+
+bool readSegments(const std::vector<std::string>& paths, std::vector<SegmentData>& segs,
+                  std::string& error) {
+    segs.assign(paths.size(), SegmentData());
+    std::vector<std::string> errors(paths.size());
+    std::vector<char> ok(paths.size(), 0);
+    parallelFor(0, paths.size(), 1, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) ok[i] = readSegment(paths[i], segs[i], errors[i]);
+    });
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!ok[i]) {
+            error = errors[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<LogEntry> mergeByTimestamp(std::vector<SegmentData>& segments) {
+    struct Head {
+        int64_t ts;
+        size_t seg;
+        size_t pos;
+        bool operator>(const Head& o) const {
+            return ts != o.ts ? ts > o.ts : (seg != o.seg ? seg > o.seg : pos > o.pos);
+        }
+    };
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+
+    size_t total = 0;
+    for (size_t s = 0; s < segments.size(); ++s) {
+        total += segments[s].entries.size();
+        if (!segments[s].entries.empty()) {
+            heads.push({segments[s].entries[0].timestamp, s, 0});
+        }
+    }
+
+    std::vector<LogEntry> merged;
+    merged.reserve(total);
+    while (!heads.empty()) {
+        Head h = heads.top();
+        heads.pop();
+        auto& list = segments[h.seg].entries;
+        merged.push_back(std::move(list[h.pos]));
+        if (h.pos + 1 < list.size()) {
+            heads.push({list[h.pos + 1].timestamp, h.seg, h.pos + 1});
+        }
+    }
+    return merged;
+}
+
+bool refreshSegment(const std::string& logPath, IdDictionary& dict, SegmentState& live) {
+    std::string error;
+    LockStats commitLock("commit");
+    int fd = openCommitted(logPath, commitLock, error);
+    if (fd == -1) {
+        live = SegmentState();
+        return true;
+    }
+    if (fd < 0) return false;
+
+    struct stat st;
+    const off_t watermark = committedLength(fd);
+    const bool statOk = ::fstat(fd, &st) == 0;
+    unlockAppendRegion(fd, &commitLock);
+    if (watermark < 0 || !statOk) {
+        ::close(fd);
+        return false;
+    }
+
+    // A new segment (logcompact) means a full replay. The watermark never
+    // points into a torn line, so an incremental replay always starts on a
+    // line boundary.
+    if (st.st_ino != live.inode || watermark < live.replayed) {
+        live = SegmentState();
+        live.inode = st.st_ino;
+    }
+
+    bool ok = true;
+    if (watermark > live.replayed) {
+        LockStats scanLock("scan");
+        const off_t from = live.replayed;
+        ok = lockRange(fd, from, watermark - from, false, &scanLock);
+        if (ok) {
+            ok = replayLog(fd, dict, live.state, from, &live.replayed, watermark);
+            unlockRange(fd, from, watermark - from, &scanLock);
+        }
+        if (!ok) live = SegmentState();
+    }
+    ::close(fd);
+    return ok;
+}
+
+long appendToSegment(const std::string& logPath, IdDictionary& dict, SegmentState& live,
+                     const std::vector<LogEntry>& entries, std::vector<std::string>& verdicts) {
+    verdicts.assign(entries.size(), std::string());
+
+    int fd = -1;
+    LockStats lockStats("append");
+    while (true) {
+        fd = openFileAppend(logPath);
+        if (fd < 0) return -1;
+        if (!lockAppendRegion(fd, true, &lockStats)) {
+            ::close(fd);
+            return -1;
+        }
+        if (isCurrentFile(fd, logPath)) break;
+        unlockAppendRegion(fd, &lockStats);
+        ::close(fd);
+    }
+
+    auto fail = [&] {
+        // state may no longer match the file; rebuild it next time
+        live = SegmentState();
+        unlockAppendRegion(fd, &lockStats);
+        ::close(fd);
+        return -1L;
+    };
+
+    TailRecovery recovery = recoverLogTail(fd, logPath);
+    if (recovery == TailRecovery::Failed) return fail();
+
+    // A new segment (logcompact) or a repaired tail means a full replay.
+    struct stat st;
+    if (::fstat(fd, &st) != 0) return fail();
+    if (st.st_ino != live.inode || recovery != TailRecovery::Clean) {
+        live = SegmentState();
+        live.inode = st.st_ino;
+    }
+    if (!replayLog(fd, dict, live.state, live.replayed, &live.replayed)) return fail();
+    const off_t previousEnd = live.replayed;
+
+    std::string lines;
+    std::vector<uint32_t> changed;
+    long accepted = 0;
+    if (!dict.beginUpdate()) return fail();
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const LogEntry& e = entries[i];
+        uint32_t idx = dict.lookup(e.personId);
+        verdicts[i] = checkEvent(live.state, idx, e.personId, e.action, e.room);
+        if (!verdicts[i].empty()) continue;
+
+        dict.intern(e.actorId);
+        idx = dict.intern(e.personId);
+        if (idx == IdDictionary::NOT_FOUND) {
+            dict.commitUpdate();
+            return fail();
+        }
+
+        // later entries in the same batch see this one
+        applyEvent(live.state, idx, e.action, e.room);
+        changed.push_back(idx);
+        char line[MAX_LOG_LINE_CHARS];
+        lines.append(line, formatLogEntry(e, line));
+        ++accepted;
+    }
+
+    if (!dict.commitUpdate()) return fail();
+
+    if (!lines.empty()) {
+        if (!appendDurable(fd, lines.data(), lines.size())) return fail();
+        live.replayed += static_cast<off_t>(lines.size());
+        publishLiveState(logPath, fd, dict, live.state, changed, previousEnd);
+    }
+
+    unlockAppendRegion(fd, &lockStats);
+    ::close(fd);
+    return accepted;
+}
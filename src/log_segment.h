@@ -0,0 +1,66 @@
+// log_segment.{h,cpp}
+// -------------------------------------
+// Reading and appending one log segment: logs/gallery.log, or one shard
+// of it (see log_layout.h). Shared by logread, logingest and the
+// GalleryLog library so they all lock, replay and validate the same way.
+//
+// Readers never hold a lock while parsing: they capture the committed
+// length under a brief shared lock on the append region, then scan only
+// [0, committed). Writers take the exclusive append-region lock for a
+// whole batch, recover a torn tail, catch up on what other writers
+// appended, check the gallery rules and append with one durable write.
+
+#ifndef LOG_SEGMENT_H
+#define LOG_SEGMENT_H
+
+#include "security_utils.h"
+#include "id_dictionary.h"
+#include "gallery_state.h"
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Everything read from one log segment.
+struct SegmentData {
+    bool found = false;                   // false if the file does not exist
+    std::vector<LogEntry> entries;
+    std::vector<std::string> checkpoints; // "<timestamp> | <personId> | <room>"
+    int64_t ckptTimestamp = -1;           // latest checkpoint, -1 if none
+};
+
+// Reads one segment. A missing file is not an error (found stays false).
+// Returns false with a message in error on failure.
+bool readSegment(const std::string& logPath, SegmentData& seg, std::string& error);
+
+// readSegment for every path, in parallel on the shared thread pool.
+// segs gets one SegmentData per path, in the same order.
+bool readSegments(const std::vector<std::string>& paths, std::vector<SegmentData>& segs,
+                  std::string& error);
+
+// k-way merge of per-shard entry lists by timestamp. Each list is already
+// in append order; ties keep segment order so output is deterministic.
+std::vector<LogEntry> mergeByTimestamp(std::vector<SegmentData>& segments);
+
+// Replayed view of one segment, kept across calls so long-running
+// processes only replay what other writers appended since last time.
+struct SegmentState {
+    StateTable state;
+    off_t replayed = 0; // bytes of the active segment already applied
+    ino_t inode = 0;    // active segment the state belongs to
+};
+
+// Read-only catch-up of live to the committed end of the segment
+// (a missing file is an empty segment). Readers pass a read-only
+// dictionary (IdDictionary::loadReadOnly), so they never lock or grow
+// gallery.ids. Returns false on I/O failure.
+bool refreshSegment(const std::string& logPath, IdDictionary& dict, SegmentState& live);
+
+// Appends entries to one segment under its append lock, checking each one
+// against live state (earlier entries of the batch included). verdicts
+// gets one string per entry: empty if written, otherwise why it was
+// rejected. Returns the number written, or -1 on I/O failure (nothing
+// was written and live is reset to force a full replay next time).
+long appendToSegment(const std::string& logPath, IdDictionary& dict, SegmentState& live,
+                     const std::vector<LogEntry>& entries, std::vector<std::string>& verdicts);
+
+#endif // LOG_SEGMENT_H
@@ -2,57 +2,55 @@
 // -------------------------------------
 // Authenticated append-only writer for the secure gallery log.
 //
-// authenticate token with APPEND permission
-// open fixed log path in append-only
-// acquire exclusive file lock
+// authenticate token (or session ticket, see session.h) with APPEND permission
+// open fixed log path (or the person's shard, see log_layout.h) in append-only
+// acquire exclusive lock on the append region (fcntl OFD byte-range lock;
+// readers of committed history never block it)
+// recover a torn last line left by a crashed writer (tail scan only)
 // reconstruct state for each person by parsing log entries
+//      (state is an array indexed by the persistent ID dictionary,
+//       replay starts from the latest checkpoint written by logcompact)
 // enforce gallery rules
 //      ENTER: only if person is not inside; room must be real (not "-")
 //      MOVE:  only if person is inside; new room != current; not "-"
 //      EXIT:  only if person is inside; room must be "-" or current room
 // format and append new log entry
+// publish the new state to the shared live state table (live_state.h)
 // never modify or delete existing log
 
 #include "security_utils.h"
+#include "id_dictionary.h"
+#include "gallery_state.h"
+#include "log_layout.h"
+#include "io_backend.h"
+#include "live_state.h"
+#include "token_store.h"
+#include "session.h"
 #include <iostream>
-#include <fstream>
 #include <vector>
-#include <unordered_map>
 #include <cerrno>
 #include <cstring>
 #include <unistd.h>
-#include <chrono>
-
-// Helper function to get current timestamp as string
-std::string getCurrentTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    return std::to_string(time_t);
-}
-
-// Simple struct to track current state of a person
-struct PersonState {
-    bool inside = false;
-    std::string room; // last known room (if inside)
-};
 
 int main(int argc, char* argv[]) {
-    // ./logappend -T <token> -E <event> -P <personId> -R <roomId>
+    // ./logappend -T <token>|-S <ticket> -E <event> -P <personId> -R <roomId>
     if (argc != 9) {
         std::cerr << "Usage: " << argv[0]
-                  << " -T <token> -E <event> -P <personId> -R <roomId>\n";
+                  << " -T <token>|-S <ticket> -E <event> -P <personId> -R <roomId>\n";
         std::cerr << "Valid events: ENTER, MOVE, EXIT\n";
         std::cerr << "Valid rooms: lobby, gallery1, gallery2, vault, security, storage, -\n";
         return 2;
     }
 
-    std::string token, event, personId, roomId;
+    std::string token, ticket, event, personId, roomId;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         if (arg == "-T" && i + 1 < argc) {
             token = argv[++i];
+        } else if (arg == "-S" && i + 1 < argc) {
+            ticket = argv[++i];
         } else if (arg == "-E" && i + 1 < argc) {
             event = argv[++i];
         } else if (arg == "-P" && i + 1 < argc) {
@@ -63,19 +61,21 @@ int main(int argc, char* argv[]) {
     }
 
     // Validate required parameters
-    if (token.empty() || event.empty() || personId.empty() || roomId.empty()) {
-        std::cerr << "Error: All parameters (-T, -E, -P, -R) are required\n";
+    if (token.empty() == ticket.empty() || event.empty() || personId.empty() || roomId.empty()) {
+        std::cerr << "Error: All parameters (-T or -S, -E, -P, -R) are required\n";
         return 2;
     }
 
-    // Validate event and room ID format
-    if (!validateAction(event)) {
+    // Validate event and room ID format, keeping the parsed codes
+    Action action;
+    Room room;
+    if (!parseAction(event, action)) {
         std::cerr << "Error: Invalid event '" << event
                   << "'. Must be ENTER, MOVE, or EXIT\n";
         return 2;
     }
 
-    if (!validateRoomId(roomId)) {
+    if (!parseRoom(roomId, room)) {
         std::cerr << "Error: Invalid room ID '" << roomId << "'\n";
         return 2;
     }
@@ -85,155 +85,133 @@ int main(int argc, char* argv[]) {
         return 2;
     }
 
-    // Authenticate token for APPEND operation
-    const auto& store = getBuiltInTokenStore();
-    const UserTokenInfo* user =
-        authenticateToken(token, Operation::Append, store);
+    // Authenticate token (or session ticket) for APPEND operation
+    UserTokenInfo session;
+    const auto store = getTokenStore(); // keeps user valid
+    const UserTokenInfo* user = ticket.empty()
+        ? authenticateToken(token, Operation::Append, store)
+        : (authenticateSession(ticket, Operation::Append, session) ? &session : nullptr);
 
     if (!user) {
         printSecureError("authentication failed");
         return 1;
     }
 
-    std::string logPath = LOG_FILE_PATH;
+    // Open the log file (or this person's shard) for appending (creates with
+    // 0600 perms if needed) and acquire the exclusive append-region lock.
+    // If logcompact swapped in a new segment or logshard changed the layout
+    // while we waited, reopen so we never append to a retired file.
+    LogLayout layout;
+    std::string logPath;
+    int fd = -1;
+    LockStats lockStats("append"); // wait/hold times go to the lock stats sink
+    while (true) {
+        if (!loadLogLayout(layout)) {
+            printSecureError("failed to read shard manifest");
+            return 1;
+        }
+        logPath = layout.pathFor(personId);
 
-    // Open the log file for appending (creates with 0600 perms if needed)
-    int fd = openFileAppend(logPath);
-    if (fd < 0) {
-        printSecureError("failed to open log file for appending");
-        return 1;
+        fd = openFileAppend(logPath);
+        if (fd < 0) {
+            printSecureError("failed to open log file for appending");
+            return 1;
+        }
+
+        if (!lockAppendRegion(fd, true, &lockStats)) {
+            printSecureError(errno == ETIMEDOUT
+                                 ? "timed out waiting for append lock on log file"
+                                 : "failed to acquire exclusive append lock on log file");
+            ::close(fd);
+            return 1;
+        }
+
+        LogLayout current;
+        if (isCurrentFile(fd, logPath) && loadLogLayout(current) &&
+            current.shards == layout.shards) break;
+        unlockAppendRegion(fd, &lockStats);
+        ::close(fd);
     }
 
-    // Acquire exclusive (writer) lock
-    if (!lockFile(fd, true)) {
-        printSecureError("failed to acquire exclusive write lock on log file");
+    // Repair or quarantine a torn last line left by a crashed writer so the
+    // new entry is never glued onto it. Only the tail is read.
+    TailRecovery recovery = recoverLogTail(fd, logPath);
+    if (recovery == TailRecovery::Failed) {
+        printSecureError("failed to recover torn log tail");
+        unlockAppendRegion(fd, &lockStats);
         ::close(fd);
         return 1;
     }
+    if (recovery == TailRecovery::Quarantined) {
+        std::cerr << "Warning: incomplete last log line moved to quarantine\n";
+    }
  
-    // Rebuild current gallery state from existing log
-    std::unordered_map<std::string, PersonState> state;
-
-    {
-        // get each log entry line
-        std::ifstream in(logPath);
-        if (in.is_open()) {
-            std::string line;
-            while (std::getline(in, line)) {
-                LogEntry e;
-                if (!parseLogLine(line, e)) {
-                    // Malformed or invalid entry -> skip defensively
-                    continue;
-                }
-                // update state of each person based on action and room (if they are inside gallery and which room)
-                auto &ps = state[e.personId];
-
-                if (e.action == "ENTER") {
-                    ps.inside = true;
-                    ps.room = e.roomId;
-                } else if (e.action == "MOVE") {
-                    // For existing log, assume it was valid when written
-                    ps.inside = true;
-                    ps.room = e.roomId;
-                } else if (e.action == "EXIT") {
-                    ps.inside = false;
-                    ps.room.clear();
-                }
-            }
-        }
+    // Load the ID dictionary so state can be kept in a plain array
+    IdDictionary dict;
+    if (!dict.load(ID_DICT_PATH)) {
+        printSecureError("failed to open ID dictionary");
+        unlockAppendRegion(fd, &lockStats);
+        ::close(fd);
+        return 1;
+    }
+
+    // Rebuild current gallery state from existing log (starting from the
+    // latest checkpoint, if the log has been compacted)
+    StateTable state;
+    off_t replayed = 0;
+    if (!replayLog(fd, dict, state, 0, &replayed)) {
+        printSecureError("failed to replay log file");
+        unlockAppendRegion(fd, &lockStats);
+        ::close(fd);
+        return 1;
     }
 
     // Enforce gallery rules for the NEW event
-    auto it = state.find(personId);
-    // checks if person exists in log
-    bool currentlyKnown = (it != state.end());
-    // checks if person is inside the gallery
-    bool currentlyInside = currentlyKnown && it->second.inside;
-    // current room person is in
-    std::string currentRoom = currentlyInside ? it->second.room : "";
-
-    if (event == "ENTER") {
-        // Person cannot ENTER if already inside
-        if (currentlyInside) {
-            std::cerr << "Error: person '" << personId
-                      << "' is already inside (in room '" << currentRoom
-                      << "'), cannot ENTER again\n";
-            unlockFile(fd);
-            ::close(fd);
-            return 2;
-        }
-        // For ENTER, roomId should be a real room, not "-"
-        if (roomId == "-") {
-            std::cerr << "Error: ENTER requires a concrete room, not '-'\n";
-            unlockFile(fd);
-            ::close(fd);
-            return 2;
-        }
-    } else if (event == "MOVE") {
-        // Must already be inside to MOVE
-        if (!currentlyInside) {
-            std::cerr << "Error: person '" << personId
-                      << "' is not currently inside, cannot MOVE\n";
-            unlockFile(fd);
-            ::close(fd);
-            return 2;
-        }
-        // Cannot MOVE to the same room
-        if (roomId == currentRoom) {
-            std::cerr << "Error: person '" << personId
-                      << "' is already in room '" << roomId
-                      << "', cannot MOVE to the same room\n";
-            unlockFile(fd);
-            ::close(fd);
-            return 2;
-        }
-        // Moving to "-" makes no sense
-        if (roomId == "-") {
-            std::cerr << "Error: MOVE requires a concrete room, not '-'\n";
-            unlockFile(fd);
-            ::close(fd);
-            return 2;
-        }
-    } else if (event == "EXIT") {
-        // Must be inside to EXIT
-        if (!currentlyInside) {
-            std::cerr << "Error: person '" << personId
-                      << "' is not currently inside, cannot EXIT\n";
-            unlockFile(fd);
-            ::close(fd);
-            return 2;
-        }
-        // For EXIT, either roomId == "-" or matches the current room
-        if (!(roomId == "-" || roomId == currentRoom)) {
-            std::cerr << "Error: EXIT room '" << roomId
-                      << "' does not match current room '" << currentRoom
-                      << "' for person '" << personId << "'\n";
-            unlockFile(fd);
-            ::close(fd);
-            return 2;
-        }
+    uint32_t idx = dict.lookup(personId);
+    std::string violation = checkEvent(state, idx, personId, action, room);
+    if (!violation.empty()) {
+        std::cerr << "Error: " << violation << "\n";
+        unlockAppendRegion(fd, &lockStats);
+        ::close(fd);
+        return 2;
+    }
+
+    // Make sure both IDs have a dictionary index before the event is logged
+    if (dict.intern(personId) == IdDictionary::NOT_FOUND ||
+        dict.intern(user->actorId) == IdDictionary::NOT_FOUND) {
+        printSecureError("failed to update ID dictionary");
+        unlockAppendRegion(fd, &lockStats);
+        ::close(fd);
+        return 1;
     }
 
     // Build and append the new log entry
     LogEntry newEntry;
     newEntry.timestamp = getCurrentTimestamp();
     newEntry.actorId   = user->actorId;  // authenticated user ID
-    newEntry.personId  = personId;
-    newEntry.action    = event;
-    newEntry.roomId    = roomId;
+    newEntry.personId.assign(personId); // validated above
+    newEntry.action    = action;
+    newEntry.room      = room;
 
     std::string logLine = formatLogEntry(newEntry);
 
-    ssize_t written = write(fd, logLine.c_str(), logLine.size());
-    if (written != static_cast<ssize_t>(logLine.size())) {
+    // One write per record keeps a crash down to a single torn line;
+    // the entry is durable before we report success.
+    if (!appendDurable(fd, logLine.data(), logLine.size())) {
         printSecureError("failed to write log entry");
-        unlockFile(fd);
+        unlockAppendRegion(fd, &lockStats);
         ::close(fd);
         return 1;
     }
 
+    // Publish the new state for lock-free readers (see live_state.h)
+    // before other writers can append behind us.
+    idx = dict.lookup(personId);
+    applyEvent(state, idx, action, room);
+    publishLiveState(logPath, fd, dict, state, {idx}, replayed);
+
     // Release lock and close
-    unlockFile(fd);
+    unlockAppendRegion(fd, &lockStats);
     ::close(fd);
 
     std::cout << "Successfully appended log entry" << std::endl;
@@ -0,0 +1,136 @@
+// logclient.cpp
+// -------------------------------------
+// Command line front end to logd, built on the coroutine client
+// (log_client.h). Also shows how a high-concurrency caller uses it.
+//
+// responsibilities:
+// connect and authenticate once per run
+// single append (same flags and messages as logappend)
+// query one person or everyone (printed like logread)
+// -n: load mode, N coroutines each append ENTER then EXIT for their own
+// person; every request is pipelined on one connection
+//
+// Requires a running logd; never touches the log files itself.
+
+#include "security_utils.h"
+#include "log_client.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+int main(int argc, char* argv[]) {
+    // ./logclient -T <token> [-s <socket>] -E <event> -P <personId> -R <roomId>
+    // ./logclient -T <token> [-s <socket>] -Q <personId|*>
+    // ./logclient -T <token> [-s <socket>] -n <count>
+    std::string token, socketPath = LOGD_SOCKET_PATH, event, personId, roomId, queryId;
+    long count = 0;
+    bool bad = argc % 2 == 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "-T")      token = argv[i + 1];
+        else if (arg == "-s") socketPath = argv[i + 1];
+        else if (arg == "-E") event = argv[i + 1];
+        else if (arg == "-P") personId = argv[i + 1];
+        else if (arg == "-R") roomId = argv[i + 1];
+        else if (arg == "-Q") queryId = argv[i + 1];
+        else if (arg == "-n") count = std::strtol(argv[i + 1], nullptr, 10);
+        else bad = true;
+    }
+
+    const bool appendMode = !event.empty() || !personId.empty() || !roomId.empty();
+    const int modes = appendMode + !queryId.empty() + (count != 0);
+    if (bad || token.empty() || modes != 1 || count < 0 ||
+        (appendMode && (event.empty() || personId.empty() || roomId.empty()))) {
+        std::cerr << "Usage: " << argv[0] << " -T <token> [-s <socket>]"
+                  << " (-E <event> -P <personId> -R <roomId> | -Q <personId|*> | -n <count>)\n";
+        return 2;
+    }
+
+    Action action = Action::Enter;
+    Room room = Room::None;
+    if (appendMode) {
+        if (!parseAction(event, action) || !validatePersonId(personId) || !parseRoom(roomId, room)) {
+            std::cerr << "Error: invalid event, person ID or room\n";
+            return 2;
+        }
+    }
+    if (!queryId.empty() && queryId != "*" && !validatePersonId(queryId)) {
+        std::cerr << "Error: invalid person ID\n";
+        return 2;
+    }
+
+    EventLoop loop;
+    LogClient log(loop);
+    int rc = 0;
+
+    loop.spawn([&]() -> Task<void> {
+        std::string error = co_await log.connect(token, socketPath);
+        if (!error.empty()) {
+            printSecureError(error);
+            rc = 1;
+            co_return;
+        }
+
+        if (appendMode) {
+            LogReply r = co_await log.append(personId, action, room);
+            if (r.ok()) {
+                std::cout << "Successfully appended log entry\n";
+            } else if (r.error == "permission denied") {
+                printSecureError(r.error);
+                rc = 1;
+            } else {
+                std::cerr << "Error: " << r.error << "\n";
+                rc = 2;
+            }
+            co_return;
+        }
+
+        if (!queryId.empty()) {
+            LogReply r = co_await log.query(queryId == "*" ? std::string_view() : queryId);
+            if (!r.ok()) {
+                printSecureError(r.error);
+                rc = 1;
+                co_return;
+            }
+            std::cout << "Parsed " << r.entries.size() << " log entries:\n";
+            char ts[MAX_TIMESTAMP_CHARS];
+            for (const auto& e : r.entries) {
+                std::cout << std::string_view(ts, formatTimestamp(e.timestamp, ts) - ts) << " | " << e.actorId << " | " << e.personId << " | "
+                          << actionName(e.action) << " | " << roomName(e.room) << "\n";
+            }
+            co_return;
+        }
+    }());
+
+    // Load mode: one coroutine per person, all in flight at once.
+    long accepted = 0, rejected = 0;
+    const auto started = std::chrono::steady_clock::now();
+    if (count > 0) {
+        loop.run(); // connect first
+        if (rc != 0) return rc;
+
+        const std::string prefix = "load" + std::to_string(::getpid()) + "_";
+        for (long i = 0; i < count; ++i) {
+            loop.spawn([&, i]() -> Task<void> {
+                const std::string pid = prefix + std::to_string(i);
+                LogReply r = co_await log.append(pid, Action::Enter, Room::Lobby);
+                if (r.ok()) r = co_await log.append(pid, Action::Exit, Room::None);
+                if (r.ok()) accepted += 2;
+                else ++rejected;
+            }());
+        }
+    }
+    loop.run();
+
+    if (count > 0) {
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cout << "Appended " << accepted << " events (" << rejected << " failed) in "
+                  << static_cast<long>(secs * 1000) << " ms, "
+                  << static_cast<long>(accepted / (secs > 0 ? secs : 1)) << " events/s\n";
+        if (rejected) rc = 1;
+    }
+    return rc;
+}
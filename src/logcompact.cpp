@@ -0,0 +1,186 @@
+// logcompact.cpp
+// -------------------------------------
+// Authenticated log compaction for the secure gallery log.
+//
+// responsibilities:
+// authenticate token with both READ and APPEND permission
+// acquire an exclusive whole-file lock on the active log (covers the
+// append region logappend locks and every range readers lock)
+// replay the active segment (every shard, if sharded) into the current
+// inside/room map
+// write a new segment that starts with a checkpoint of that map and
+// point the live state table at it
+// hard-link the old segment into logs/archive/, then rename the new
+// segment over logs/gallery.log
+//
+// Existing bytes are never modified: the old segment survives unchanged
+// in the archive, and the new active segment is only ever appended to.
+// Writers that opened the old segment before the swap notice the inode
+// change after taking the lock and reopen (see isCurrentFile).
+
+#include "security_utils.h"
+#include "id_dictionary.h"
+#include "gallery_state.h"
+#include "log_layout.h"
+#include "live_state.h"
+#include "token_store.h"
+#include <iostream>
+#include <string>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const std::string ARCHIVE_DIR = "logs/archive";
+
+// Pick an unused archive name: logs/archive/<segment>.<ts>.log[.<n>]
+// e.g. gallery.<ts>.log, or gallery.<k>.<ts>.log for shard k
+static std::string archivePathFor(const std::string& logPath, const std::string& timestamp) {
+    std::string name = logPath.substr(logPath.rfind('/') + 1);
+    name = name.substr(0, name.size() - 4); // strip ".log"
+    std::string base = ARCHIVE_DIR + "/" + name + "." + timestamp + ".log";
+    std::string path = base;
+    struct stat st;
+    for (int n = 1; ::stat(path.c_str(), &st) == 0; ++n) {
+        path = base + "." + std::to_string(n);
+    }
+    return path;
+}
+
+// fsync a directory so renames/links in it are durable
+static void syncDir(const std::string& dir) {
+    int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        (void)::fsync(dfd);
+        ::close(dfd);
+    }
+}
+
+// Compacts one active segment. Returns 0 on success (or nothing to do),
+// 1 on failure after printing an error.
+static int compactSegment(const std::string& logPath, IdDictionary& dict, int64_t timestamp) {
+    const std::string tmpPath = logPath + ".compact.tmp";
+
+    // Open and lock the active segment, reopening if it was swapped.
+    int fd = -1;
+    LockStats lockStats("compact");
+    while (true) {
+        fd = ::open(logPath.c_str(), O_RDWR);
+        if (fd < 0) {
+            if (errno == ENOENT) {
+                std::cout << "No log file at " << logPath << ". Nothing to compact.\n";
+                return 0;
+            }
+            printSecureError("failed to open log file");
+            return 1;
+        }
+
+        if (!lockFile(fd, true, &lockStats)) {
+            printSecureError(errno == ETIMEDOUT
+                                 ? "timed out waiting for exclusive lock on log file"
+                                 : "failed to acquire exclusive write lock on log file");
+            ::close(fd);
+            return 1;
+        }
+
+        if (isCurrentFile(fd, logPath)) break;
+        unlockFile(fd, &lockStats);
+        ::close(fd);
+    }
+
+    auto fail = [&](const std::string& msg) {
+        printSecureError(msg);
+        ::unlink(tmpPath.c_str());
+        unlockFile(fd, &lockStats);
+        ::close(fd);
+        return 1;
+    };
+
+    // The archived segment should not end in a torn line either.
+    if (recoverLogTail(fd, logPath) == TailRecovery::Failed) {
+        return fail("failed to recover torn log tail");
+    }
+
+    StateTable state;
+    if (!replayLog(fd, dict, state)) return fail("failed to replay log file");
+
+    // Write the new segment (checkpoint only) next to the active log.
+    const std::string checkpoint = formatCheckpoint(state, dict, timestamp);
+
+    int out = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (out < 0) return fail("failed to create new log segment");
+
+    ssize_t written = ::write(out, checkpoint.data(), checkpoint.size());
+    bool ok = written == static_cast<ssize_t>(checkpoint.size()) && ::fsync(out) == 0;
+    // Same state, new inode: move the live state table over to the new
+    // segment while no writer can reach it yet.
+    if (ok) publishLiveState(logPath, out, dict, state, {}, -1);
+    ::close(out);
+    if (!ok) return fail("failed to write checkpoint");
+
+    // Keep the old segment in the archive, then atomically make the new
+    // segment active. A crash between the two steps leaves the old segment
+    // both active and archived, which is safe to compact again.
+    const std::string archivePath = archivePathFor(logPath, formatTimestamp(timestamp));
+    if (::link(logPath.c_str(), archivePath.c_str()) != 0) {
+        return fail("failed to archive old log segment");
+    }
+    syncDir(ARCHIVE_DIR);
+
+    if (::rename(tmpPath.c_str(), logPath.c_str()) != 0) {
+        return fail("failed to activate new log segment");
+    }
+    syncDir("logs");
+
+    unlockFile(fd, &lockStats);
+    ::close(fd);
+
+    size_t inside = 0;
+    for (const auto& ps : state) inside += ps.inside();
+    std::cout << "Compacted " << logPath << ": " << inside
+              << " people inside at checkpoint " << formatTimestamp(timestamp) << "\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // ./logcompact -T <token>
+    if (argc != 3 || std::string(argv[1]) != "-T") {
+        std::cerr << "Usage: " << argv[0] << " -T <token>\n";
+        return 2;
+    }
+
+    // Compaction rewrites which file is active, so require both operations.
+    const auto& store = getTokenStore();
+    const UserTokenInfo* user =
+        authenticateToken(argv[2], Operation::Append, store);
+
+    if (!user || !permissionAllows(user->permission, Operation::Read)) {
+        printSecureError("authentication failed");
+        return 1;
+    }
+
+    LogLayout layout;
+    if (!loadLogLayout(layout)) {
+        printSecureError("failed to read shard manifest");
+        return 1;
+    }
+
+    IdDictionary dict;
+    if (!dict.load(ID_DICT_PATH)) {
+        printSecureError("failed to open ID dictionary");
+        return 1;
+    }
+
+    if (::mkdir(ARCHIVE_DIR.c_str(), 0700) != 0 && errno != EEXIST) {
+        printSecureError("failed to create archive directory");
+        return 1;
+    }
+
+    // Every shard is its own segment with its own lock and checkpoint.
+    const int64_t timestamp = getCurrentTimestamp();
+    int rc = 0;
+    for (const auto& path : layout.segmentPaths()) {
+        rc |= compactSegment(path, dict, timestamp);
+    }
+    return rc;
+}
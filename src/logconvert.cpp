@@ -0,0 +1,325 @@
+// logconvert.cpp
+// -------------------------------------
+// Authenticated streaming converter between the text log and the binary
+// log format (see binary_log.h).
+//
+// responsibilities:
+// authenticate token with READ permission
+// capture the committed input length (committedLength) while briefly
+// share-locking the append region, so a live log can be converted while
+// logappend keeps writing
+// mmap the input and convert it window by window; each window is split
+// into chunks converted on the shared thread pool (-j threads) whose
+// output is reassembled in input order
+// validate every text line with parseLogLine (checkpoint lines with the
+// checkpoint parsers) and every binary record with the same rules
+// (unpackRecord, unpackCheckpointRecord), reporting rejects with their offset
+// write output through 1 MiB page-aligned buffers
+// never modify the input; output is created new with 0600 perms
+
+#include "security_utils.h"
+#include "text_scan.h"
+#include "binary_log.h"
+#include "thread_pool.h"
+#include "token_store.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum class Mode { TextToBinary, BinaryToText };
+
+static constexpr size_t CHUNK_BYTES = 4u << 20; // input bytes per pool task
+static constexpr unsigned CHUNKS_PER_JOB = 4;    // per window; spare chunks keep stealers busy
+
+// One rejected line/record.
+struct Rejection {
+    uint64_t offset; // byte offset in the input file
+};
+
+// Output of one chunk, written in order once every chunk of a window is done.
+struct ChunkResult {
+    std::string out;
+    std::vector<Rejection> rejected;
+    uint64_t converted = 0;
+};
+
+// Buffers output into page-aligned 1 MiB blocks so the file is written
+// with large, aligned sequential writes.
+class AlignedWriter {
+public:
+    static constexpr size_t BLOCK = 1u << 20;
+
+    explicit AlignedWriter(int fd) : fd_(fd) {
+        if (::posix_memalign(reinterpret_cast<void**>(&buf_), 4096, BLOCK) != 0) buf_ = nullptr;
+    }
+    ~AlignedWriter() { std::free(buf_); }
+    AlignedWriter(const AlignedWriter&) = delete;
+    AlignedWriter& operator=(const AlignedWriter&) = delete;
+
+    bool ok() const { return buf_ != nullptr && ok_; }
+
+    void write(const char* p, size_t n) {
+        while (n > 0 && ok()) {
+            size_t take = std::min(n, BLOCK - used_);
+            std::memcpy(buf_ + used_, p, take);
+            used_ += take;
+            p += take;
+            n -= take;
+            if (used_ == BLOCK) flush();
+        }
+    }
+
+    bool finish() {
+        if (used_ > 0) flush();
+        return ok() && ::fsync(fd_) == 0;
+    }
+
+private:
+    void flush() {
+        size_t done = 0;
+        while (done < used_) {
+            ssize_t n = ::write(fd_, buf_ + done, used_ - done);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ok_ = false;
+                return;
+            }
+            done += static_cast<size_t>(n);
+        }
+        used_ = 0;
+    }
+
+    int fd_;
+    char* buf_ = nullptr;
+    size_t used_ = 0;
+    bool ok_ = true;
+};
+
+// Convert text lines in [begin, end) of data; begin is a line start and
+// end a line end (the input is cut at its committed length).
+static void textChunkToBinary(const char* data, size_t begin, size_t end, ChunkResult& r) {
+    forEachScannedLine(data + begin, end - begin, [&](std::string_view line, const LineMasks& masks) {
+        LogEntry e;
+        BinaryLogRecord rec;
+        if (parseLogLine(line, masks, e)) {
+            packRecord(e, rec);
+        } else if (!packCheckpointLine(line, rec)) {
+            r.rejected.push_back({static_cast<size_t>(line.data() - data)});
+            return;
+        }
+        r.out.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+        ++r.converted;
+    });
+}
+
+// Convert binary records in [begin, end) of data; both are record aligned.
+static void binaryChunkToText(const char* data, size_t begin, size_t end, uint32_t version,
+                              ChunkResult& r) {
+    for (size_t pos = begin; pos + sizeof(BinaryLogRecord) <= end; pos += sizeof(BinaryLogRecord)) {
+        BinaryLogRecord rec;
+        std::memcpy(&rec, data + pos, sizeof(rec)); // mmap data has no alignment guarantee
+
+        LogEntry e;
+        if (unpackRecord(rec, e, version)) {
+            char line[MAX_LOG_LINE_CHARS];
+            r.out.append(line, formatLogEntry(e, line));
+            ++r.converted;
+        } else if (unpackCheckpointRecord(rec, r.out, version)) {
+            ++r.converted;
+        } else {
+            r.rejected.push_back({pos});
+        }
+    }
+}
+
+// Move pos forward to the start of the next line (or to limit).
+static size_t nextLineStart(const char* data, size_t pos, size_t limit) {
+    if (pos >= limit) return limit;
+    const char* nl = static_cast<const char*>(std::memchr(data + pos, '\n', limit - pos));
+    return nl ? static_cast<size_t>(nl - data) + 1 : limit;
+}
+
+int main(int argc, char* argv[]) {
+    // ./logconvert -T <token> -m <text2bin|bin2text> -i <input> -o <output> [-j <threads>]
+    std::string token, mode, inPath, outPath;
+    unsigned jobs = 0; // 0 = GALLERYLOG_JOBS or the CPU count
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "-T")      token = argv[i + 1];
+        else if (arg == "-m") mode = argv[i + 1];
+        else if (arg == "-i") inPath = argv[i + 1];
+        else if (arg == "-o") outPath = argv[i + 1];
+        else if (arg == "-j") {
+            if (!parseJobs(argv[i + 1], jobs)) token.clear(); // bad value -> usage error below
+        }
+        else token.clear(); // unknown flag -> usage error below
+    }
+
+    if (argc % 2 == 0 || token.empty() || inPath.empty() || outPath.empty() ||
+        (mode != "text2bin" && mode != "bin2text")) {
+        std::cerr << "Usage: " << argv[0]
+                  << " -T <token> -m <text2bin|bin2text> -i <input> -o <output> [-j <threads>]\n";
+        return 2;
+    }
+    setThreadPoolJobs(jobs);
+    const Mode m = (mode == "text2bin") ? Mode::TextToBinary : Mode::BinaryToText;
+
+    // Converting exposes the whole log, so require READ permission.
+    const auto& store = getTokenStore();
+    if (!authenticateToken(token, Operation::Read, store)) {
+        printSecureError("authentication failed");
+        return 1;
+    }
+
+    int in = openFileRO(inPath);
+    if (in < 0) {
+        printSecureError("failed to open input file");
+        return 1;
+    }
+
+    // Like the other readers, wait only for an append in progress and take
+    // the committed length: everything below it is immutable, so the rest
+    // of the conversion runs without a lock. A text input is cut after its
+    // last complete line; nothing appends to binary files, which are
+    // taken whole.
+    struct stat st;
+    LockStats lockStats("commit");
+    if (!lockAppendRegion(in, false, &lockStats)) {
+        printSecureError("failed to read input size");
+        ::close(in);
+        return 1;
+    }
+    const off_t committed = m == Mode::TextToBinary ? committedLength(in) : 0;
+    const bool sized = ::fstat(in, &st) == 0 && committed >= 0;
+    unlockAppendRegion(in, &lockStats);
+    if (!sized) {
+        printSecureError("failed to read input size");
+        ::close(in);
+        return 1;
+    }
+    const size_t inSize = static_cast<size_t>(m == Mode::TextToBinary ? committed : st.st_size);
+    const bool textTail = m == Mode::TextToBinary && st.st_size > committed;
+
+    int out = ::open(outPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (out < 0) {
+        printSecureError("failed to create output file (it must not exist)");
+        ::close(in);
+        return 1;
+    }
+
+    const char* data = nullptr;
+    if (inSize > 0) {
+        void* map = ::mmap(nullptr, inSize, PROT_READ, MAP_PRIVATE, in, 0);
+        if (map == MAP_FAILED) {
+            printSecureError("failed to map input file");
+            ::close(in);
+            ::close(out);
+            return 1;
+        }
+        ::madvise(map, inSize, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(map);
+    }
+
+    AlignedWriter writer(out);
+    size_t pos = 0;
+    uint64_t converted = 0, rejected = 0;
+    uint32_t version = BINARY_LOG_VERSION; // of the binary input
+
+    if (m == Mode::TextToBinary) {
+        BinaryLogHeader h;
+        initBinaryHeader(h);
+        writer.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    } else {
+        BinaryLogHeader h;
+        if (inSize < sizeof(h) || (std::memcpy(&h, data, sizeof(h)), !checkBinaryHeader(h))) {
+            printSecureError("input is not a binary gallery log");
+            if (data) ::munmap(const_cast<char*>(data), inSize);
+            ::close(in);
+            ::close(out);
+            ::unlink(outPath.c_str());
+            return 1;
+        }
+        pos = sizeof(h);
+        version = h.version;
+    }
+
+    const unsigned chunks = threadPoolJobs() * CHUNKS_PER_JOB;
+    std::vector<ChunkResult> results(chunks);
+    std::vector<size_t> bounds(chunks + 1);
+
+    while (pos < inSize && writer.ok()) {
+        // Carve one window into chunks on line/record boundaries.
+        const size_t windowEnd = std::min(inSize, pos + CHUNK_BYTES * chunks);
+        bounds[0] = pos;
+        for (unsigned j = 1; j <= chunks; ++j) {
+            size_t target = std::min(windowEnd, pos + CHUNK_BYTES * j);
+            if (m == Mode::TextToBinary) {
+                bounds[j] = (target == inSize) ? inSize : nextLineStart(data, target, inSize);
+            } else {
+                size_t rel = (target - sizeof(BinaryLogHeader)) / sizeof(BinaryLogRecord);
+                bounds[j] = std::min(windowEnd, sizeof(BinaryLogHeader) + rel * sizeof(BinaryLogRecord));
+                if (target == inSize) bounds[j] = inSize;
+            }
+            bounds[j] = std::max(bounds[j], bounds[j - 1]);
+        }
+
+        parallelFor(0, chunks, 1, [&](size_t b, size_t e) {
+            for (size_t j = b; j < e; ++j) {
+                results[j] = ChunkResult();
+                if (m == Mode::TextToBinary) textChunkToBinary(data, bounds[j], bounds[j + 1], results[j]);
+                else                         binaryChunkToText(data, bounds[j], bounds[j + 1], version, results[j]);
+            }
+        });
+
+        // Reassemble in input order.
+        for (unsigned j = 0; j < chunks; ++j) {
+            const ChunkResult& r = results[j];
+            writer.write(r.out.data(), r.out.size());
+            converted += r.converted;
+            rejected += r.rejected.size();
+            for (const auto& rej : r.rejected) {
+                std::cerr << "rejected " << (m == Mode::TextToBinary ? "line" : "record")
+                          << " at offset " << rej.offset << "\n";
+            }
+        }
+
+        // Processed input is not needed again; drop it from the page cache.
+        const size_t done = bounds[chunks];
+        ::madvise(const_cast<char*>(data) + (pos & ~size_t(4095)),
+                  (done & ~size_t(4095)) - (pos & ~size_t(4095)), MADV_DONTNEED);
+        pos = done;
+    }
+
+    // A text line without its '\n' (torn, or not committed yet) and a
+    // trailing partial record cannot be converted.
+    if (textTail) {
+        std::cerr << "rejected line at offset " << inSize << "\n";
+        ++rejected;
+    }
+    if (m == Mode::BinaryToText && (inSize - sizeof(BinaryLogHeader)) % sizeof(BinaryLogRecord) != 0) {
+        size_t off = inSize - (inSize - sizeof(BinaryLogHeader)) % sizeof(BinaryLogRecord);
+        std::cerr << "rejected record at offset " << off << "\n";
+        ++rejected;
+    }
+
+    bool ok = writer.finish();
+    if (data) ::munmap(const_cast<char*>(data), inSize);
+    ::close(in);
+    ::close(out);
+
+    if (!ok) {
+        printSecureError("failed to write output file");
+        return 1;
+    }
+
+    std::cout << "Converted " << converted << " entries, rejected " << rejected << "\n";
+    return 0;
+}
@@ -0,0 +1,663 @@
+// logd.cpp
+// -------------------------------------
+// Local gallery log service: one process that owns the log for many
+// concurrent clients, spoken to over a Unix socket with the pipelined
+// line protocol in log_protocol.h (see log_client.h for the C++ client).
+//
+// responsibilities:
+// create the socket (0600, logs/gallerylog.sock by default)
+// run a single-threaded epoll loop over every connection
+// authenticate each connection once (AUTH), then accept any number of
+// pipelined APPEND / QUERY requests without waiting for replies
+// hand appends to one GalleryLog per token (its writer thread does the
+// locking, rule checks and durable writes)
+// run queries on a worker thread so long scans never stall the loop, and
+// stream their results in chunks that wait for the client to drain them
+// route results back to the loop through an eventfd and answer with the
+// request's id
+// pause reading from a connection with too many requests in flight
+// reload the token store on SIGHUP or when the store file changes
+// (inotify), and close connections whose token no longer authenticates
+// (told with LOGD_NOTICE_ID)
+// SIGINT/SIGTERM: stop accepting, finish queued appends and exit
+
+#include "security_utils.h"
+#include "gallery_log.h"
+#include "log_protocol.h"
+#include "token_store.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static constexpr size_t MAX_INFLIGHT = 65536;    // per connection
+static constexpr size_t MAX_OUTBUF   = 8u << 20; // pending reply bytes per connection
+static constexpr size_t QUERY_CHUNK  = 256u << 10; // QUERY results handed over at a time
+static constexpr int    MAX_EVENTS   = 256;
+
+// epoll ids below FIRST_CONN are the daemon's own fds
+static constexpr uint64_t LISTEN_ID = 0, WAKE_ID = 1, SIGNAL_ID = 2, TOKENS_ID = 3, FIRST_CONN = 16;
+
+// Replies produced off the event loop (GalleryLog writer threads and the
+// query worker), handed back through an eventfd.
+struct Completion {
+    uint64_t conn;
+    std::string text;
+    bool last;  // false: more of a QUERY's results follow
+    bool query; // the query worker waits for QueryWorker::resume()
+};
+
+class CompletionQueue {
+public:
+    bool init() {
+        efd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return efd_ >= 0;
+    }
+    int fd() const { return efd_; }
+
+    // text holds complete reply lines; last once the request is answered
+    void post(uint64_t conn, std::string text, bool last = true, bool query = false) {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            wake = items_.empty(); // the loop has not been signalled yet
+            items_.push_back({conn, std::move(text), last, query});
+        }
+        if (wake) {
+            uint64_t one = 1;
+            (void)::write(efd_, &one, sizeof(one));
+        }
+    }
+
+    void take(std::vector<Completion>& out) {
+        uint64_t n;
+        (void)::read(efd_, &n, sizeof(n));
+        std::lock_guard<std::mutex> lk(mutex_);
+        out.swap(items_);
+    }
+
+private:
+    int efd_ = -1;
+    std::mutex mutex_;
+    std::vector<Completion> items_;
+};
+
+// file scope so append callbacks only capture two ids (no allocation)
+static CompletionQueue completions;
+
+// Runs QUERY requests on its own thread, QUERY_CHUNK of results at a time.
+// Each connection has a cursor: its queued queries, and the results of the
+// one being answered with how far they were sent. After posting a chunk a
+// connection is parked until the loop resume()s it, which the loop does
+// once that connection's unsent output is under MAX_OUTBUF; meanwhile the
+// worker serves the other connections in turn, so a client that stops
+// reading holds back only its own queries, with at most one result set
+// and MAX_OUTBUF plus a chunk of output.
+class QueryWorker {
+public:
+    QueryWorker() : thread_([this] { run(); }) {}
+    ~QueryWorker() {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    void submit(uint64_t conn, uint64_t id, std::string personId) {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            Cursor& c = cursors_[conn];
+            c.jobs.push_back({id, std::move(personId)});
+            if (c.jobs.size() == 1 && !c.busy && !c.parked) ready_.push_back(conn);
+        }
+        cv_.notify_one();
+    }
+
+    // The connection's last chunk was taken in: go on with its queries.
+    void resume(uint64_t conn) {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            auto it = cursors_.find(conn);
+            if (it == cursors_.end() || !it->second.parked) return;
+            it->second.parked = false;
+            if (it->second.jobs.empty()) {
+                cursors_.erase(it);
+                return;
+            }
+            ready_.push_back(conn);
+        }
+        cv_.notify_one();
+    }
+
+    // The connection is gone: drop its queries and results.
+    void cancel(uint64_t conn) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto it = cursors_.find(conn);
+        if (it == cursors_.end()) return;
+        if (it->second.busy) it->second.cancelled = true; // the worker drops it
+        else cursors_.erase(it); // a stale ready_ entry is skipped
+    }
+
+private:
+    struct Job {
+        uint64_t id;
+        std::string personId;
+    };
+
+    struct Cursor {
+        std::deque<Job> jobs;          // front is the query being answered
+        std::vector<LogEntry> results; // worker only, while busy
+        size_t sent = 0;
+        bool started = false;
+        bool busy = false;      // the worker is formatting a chunk
+        bool parked = false;    // a chunk was posted, waiting for resume()
+        bool cancelled = false;
+    };
+
+    void run() {
+        while (true) {
+            uint64_t conn;
+            Cursor* c;
+            Job job;
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                cv_.wait(lk, [&] { return stop_ || !ready_.empty(); });
+                if (stop_) return; // the loop is gone; nobody to answer
+                conn = ready_.front();
+                ready_.pop_front();
+                auto it = cursors_.find(conn);
+                if (it == cursors_.end()) continue; // cancelled
+                c = &it->second; // stays valid: only this thread erases a busy cursor
+                c->busy = true;
+                job = c->jobs.front();
+            }
+
+            std::string text;
+            const bool last = nextChunk(*c, job, text);
+
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                c->busy = false;
+                if (c->cancelled) {
+                    cursors_.erase(conn);
+                    continue;
+                }
+                if (last) {
+                    c->jobs.pop_front();
+                    std::vector<LogEntry>().swap(c->results);
+                    c->sent = 0;
+                    c->started = false;
+                }
+                c->parked = true;
+            }
+            completions.post(conn, std::move(text), last, true);
+        }
+    }
+
+    // Formats the next chunk of job's reply; true once it ends the reply.
+    static bool nextChunk(Cursor& c, const Job& job, std::string& text) {
+        if (!c.started) {
+            c.started = true;
+            LogFilter filter;
+            filter.personId = job.personId;
+            std::string error;
+            if (!collectLog(filter, c.results, &error)) {
+                formatLogdResponse(text, job.id, LogdReply::Err, error);
+                return true;
+            }
+        }
+        while (c.sent < c.results.size() && text.size() < QUERY_CHUNK) {
+            char line[MAX_LOG_LINE_CHARS];
+            const char* end = formatLogEntry(c.results[c.sent++], line) - 1; // without '\n'
+            formatLogdResponse(text, job.id, LogdReply::Entry, std::string_view(line, end - line));
+        }
+        if (c.sent < c.results.size()) return false;
+        formatLogdResponse(text, job.id, LogdReply::Ok);
+        return true;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<uint64_t, Cursor> cursors_; // by connection
+    std::deque<uint64_t> ready_;                   // connections with work, in turn
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+struct Connection {
+    int fd = -1;
+    std::string in;
+    std::string out;
+    size_t pending = 0;       // requests accepted, not answered yet
+    bool authed = false;
+    Digest tokenHash{};       // what AUTH proved, rechecked on reload
+    GalleryId actorId;
+    Permission permission{};
+    bool canRead = false;
+    GalleryLog* log = nullptr; // set if the token may append
+    bool paused = false;      // EPOLLIN removed (backpressure)
+    bool queryWaits = false;  // its queries are parked until out drains
+    bool wantWrite = false;   // EPOLLOUT registered
+    bool closing = false;     // stop reading; close once answered and flushed
+    bool eof = false;         // peer finished sending
+};
+
+class Server {
+public:
+    bool init(const std::string& socketPath);
+    void run();
+
+private:
+    void accept();
+    void onReadable(uint64_t id);
+    void processInput(uint64_t id, Connection& c);
+    void handleRequest(uint64_t id, Connection& c, const LogdRequest& req);
+    void flush(uint64_t id);
+    void updateInterest(uint64_t id, Connection& c);
+    void close(uint64_t id);
+    void reloadTokens();
+
+    int epfd_ = -1;
+    int listenFd_ = -1;
+    int sigFd_ = -1;
+    TokenStoreWatch tokenWatch_;
+    uint64_t nextConn_ = FIRST_CONN;
+    std::map<uint64_t, Connection> conns_;
+    std::vector<uint64_t> dirty_;                             // have unsent output
+    std::map<Digest, std::unique_ptr<GalleryLog>> logs_; // by token digest
+    QueryWorker queries_;
+};
+
+bool Server::init(const std::string& socketPath) {
+    epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epfd_ < 0 || !completions.init()) return false;
+
+    // SIGINT/SIGTERM/SIGHUP arrive as readable events; threads inherit
+    // the mask.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigFd_ = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigFd_ < 0) return false;
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) return false;
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) return false;
+
+    // A socket nobody answers on is left over from a crash: replace it.
+    struct stat st;
+    if (::lstat(socketPath.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) return false;
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 &&
+                    ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        if (probe >= 0) ::close(probe);
+        if (live) {
+            std::cerr << "Error: logd is already running on " << socketPath << "\n";
+            return false;
+        }
+        ::unlink(socketPath.c_str());
+    }
+
+    // only the log owner may connect
+    mode_t old = ::umask(077);
+    int rc = ::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    ::umask(old);
+    if (rc != 0 || ::listen(listenFd_, SOMAXCONN) != 0) return false;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = LISTEN_ID;
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, listenFd_, &ev) != 0) return false;
+    ev.data.u64 = WAKE_ID;
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, completions.fd(), &ev) != 0) return false;
+    ev.data.u64 = SIGNAL_ID;
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, sigFd_, &ev) != 0) return false;
+
+    // Without inotify the store is still reloaded on SIGHUP.
+    if (tokenWatch_.start()) {
+        ev.data.u64 = TOKENS_ID;
+        ::epoll_ctl(epfd_, EPOLL_CTL_ADD, tokenWatch_.fd(), &ev);
+    }
+    return true;
+}
+
+void Server::accept() {
+    while (true) {
+        int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return; // EAGAIN, or out of fds: try again on the next event
+
+        uint64_t id = nextConn_++;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = id;
+        if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            ::close(fd);
+            continue;
+        }
+        conns_[id].fd = fd;
+    }
+}
+
+void Server::onReadable(uint64_t id) {
+    auto it = conns_.find(id);
+    if (it == conns_.end()) return;
+    Connection& c = it->second;
+
+    char buf[64 * 1024];
+    while (true) {
+        ssize_t n = ::read(c.fd, buf, sizeof(buf));
+        if (n > 0) {
+            c.in.append(buf, static_cast<size_t>(n));
+            if (c.in.size() > 4 * LOGD_MAX_LINE + MAX_INFLIGHT * 64) break; // parse before reading more
+            continue;
+        }
+        if (n == 0) {
+            // half-close: still answer what was sent, then close
+            c.eof = true;
+            break;
+        }
+        if (errno == EAGAIN) break;
+        if (errno != EINTR) {
+            close(id); // peer gone; replies still in flight are dropped
+            return;
+        }
+    }
+    processInput(id, c);
+}
+
+void Server::processInput(uint64_t id, Connection& c) {
+    size_t start = 0;
+    while (!c.closing && c.pending < MAX_INFLIGHT && c.out.size() < MAX_OUTBUF) {
+        size_t nl = c.in.find('\n', start);
+        if (nl == std::string::npos) break;
+        std::string_view line(c.in.data() + start, nl - start);
+        start = nl + 1;
+
+        LogdRequest req;
+        if (!parseLogdRequest(line, req)) {
+            formatLogdResponse(c.out, req.id, LogdReply::Err, "malformed request");
+            continue;
+        }
+        handleRequest(id, c, req);
+    }
+    c.in.erase(0, start);
+
+    // An unterminated line longer than any valid request: drop the client.
+    if (c.in.size() > LOGD_MAX_LINE && c.in.find('\n') == std::string::npos) c.closing = true;
+
+    if (!c.out.empty() || c.closing || c.eof) dirty_.push_back(id);
+    updateInterest(id, c);
+}
+
+void Server::handleRequest(uint64_t id, Connection& c, const LogdRequest& req) {
+    if (req.verb == LogdVerb::Auth) {
+        const std::string token(req.token);
+        const auto& store = getTokenStore();
+        const UserTokenInfo* user = authenticateToken(token, Operation::Append, store);
+        const bool canAppend = user != nullptr;
+        if (!user) user = authenticateToken(token, Operation::Read, store);
+
+        if (c.authed || !user) {
+            formatLogdResponse(c.out, req.id, LogdReply::Err, "authentication failed");
+            c.closing = true;
+            return;
+        }
+
+        c.authed = true;
+        c.tokenHash = user->tokenHash;
+        c.actorId = user->actorId;
+        c.permission = user->permission;
+        c.canRead = permissionAllows(user->permission, Operation::Read);
+        if (canAppend) {
+            auto& log = logs_[user->tokenHash];
+            std::string error;
+            if (!log) log = GalleryLog::open(token, &error);
+            if (!log) {
+                logs_.erase(user->tokenHash);
+                formatLogdResponse(c.out, req.id, LogdReply::Err, error);
+                c.closing = true;
+                return;
+            }
+            c.log = log.get();
+        }
+        formatLogdResponse(c.out, req.id, LogdReply::Ok);
+        return;
+    }
+
+    if (!c.authed) {
+        formatLogdResponse(c.out, req.id, LogdReply::Err, "authentication required");
+        c.closing = true;
+        return;
+    }
+
+    if (req.verb == LogdVerb::Append) {
+        if (!c.log) {
+            formatLogdResponse(c.out, req.id, LogdReply::Err, "permission denied");
+            return;
+        }
+        ++c.pending;
+        const uint64_t reqId = req.id;
+        c.log->append({std::string(req.personId), req.action, req.room},
+                      [id, reqId](const std::string& error) {
+                          std::string text;
+                          if (error.empty()) formatLogdResponse(text, reqId, LogdReply::Ok);
+                          else formatLogdResponse(text, reqId, LogdReply::Err, error);
+                          completions.post(id, std::move(text));
+                      });
+        return;
+    }
+
+    // QUERY
+    if (!c.canRead) {
+        formatLogdResponse(c.out, req.id, LogdReply::Err, "permission denied");
+        return;
+    }
+    ++c.pending;
+    queries_.submit(id, req.id, std::string(req.personId));
+}
+
+void Server::flush(uint64_t id) {
+    auto it = conns_.find(id);
+    if (it == conns_.end()) return;
+    Connection& c = it->second;
+
+    size_t done = 0;
+    while (done < c.out.size()) {
+        ssize_t n = ::send(c.fd, c.out.data() + done, c.out.size() - done, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            close(id);
+            return;
+        }
+        done += static_cast<size_t>(n);
+    }
+    c.out.erase(0, done);
+    if (c.queryWaits && c.out.size() < MAX_OUTBUF) {
+        c.queryWaits = false;
+        queries_.resume(id);
+    }
+
+    if (c.out.empty() && c.pending == 0 && (c.closing || c.eof)) {
+        close(id);
+        return;
+    }
+    // output drained below the limit: resume parsing buffered requests
+    if (c.paused && c.pending < MAX_INFLIGHT && c.out.size() < MAX_OUTBUF) processInput(id, c);
+    else updateInterest(id, c);
+}
+
+void Server::updateInterest(uint64_t id, Connection& c) {
+    const bool pause = c.closing || c.eof || c.pending >= MAX_INFLIGHT || c.out.size() >= MAX_OUTBUF;
+    const bool write = !c.out.empty();
+    if (pause == c.paused && write == c.wantWrite) return;
+
+    epoll_event ev{};
+    ev.events = (pause ? 0u : static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP)) |
+                (write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    ev.data.u64 = id;
+    ::epoll_ctl(epfd_, EPOLL_CTL_MOD, c.fd, &ev);
+    c.paused = pause;
+    c.wantWrite = write;
+}
+
+void Server::close(uint64_t id) {
+    auto it = conns_.find(id);
+    if (it == conns_.end()) return;
+    queries_.cancel(id);
+    ::epoll_ctl(epfd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    ::close(it->second.fd);
+    conns_.erase(it);
+}
+
+// A rotated token must stop working on connections that already used it:
+// those whose token is gone or now maps to another actor or permission
+// finish the requests they have in flight and are closed. The token's
+// GalleryLog rejects whatever it still holds and is dropped.
+void Server::reloadTokens() {
+    std::string error;
+    if (!reloadTokenStore(error)) {
+        printSecureError(error + "; keeping the current token store");
+        return;
+    }
+    const auto store = getTokenStore();
+    std::cout << "Token store reloaded (" << store->size() << " tokens)" << std::endl;
+
+    for (auto& [id, c] : conns_) {
+        if (!c.authed || c.closing) continue;
+        const UserTokenInfo* user = store->find(c.tokenHash);
+        const bool same = user && user->permission == c.permission && user->actorId == c.actorId;
+        if (same) continue;
+        formatLogdResponse(c.out, LOGD_NOTICE_ID, LogdReply::Err, "token revoked");
+        c.closing = true;
+        c.log = nullptr;
+        dirty_.push_back(id);
+    }
+    for (auto it = logs_.begin(); it != logs_.end();) {
+        if (it->second->authorized()) ++it;
+        else it = logs_.erase(it); // waits for its queued events (rejected)
+    }
+}
+
+void Server::run() {
+    epoll_event events[MAX_EVENTS];
+    std::vector<Completion> done;
+
+    while (true) {
+        int n = ::epoll_wait(epfd_, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            printSecureError("event loop failed");
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const uint64_t id = events[i].data.u64;
+            if (id == SIGNAL_ID) {
+                signalfd_siginfo si;
+                bool stop = false, reload = false;
+                while (::read(sigFd_, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGHUP) reload = true;
+                    else stop = true;
+                }
+                if (stop) return;
+                if (reload) reloadTokens();
+                continue;
+            }
+            if (id == TOKENS_ID) {
+                if (tokenWatch_.changed()) reloadTokens();
+                continue;
+            }
+            if (id == LISTEN_ID) {
+                accept();
+            } else if (id == WAKE_ID) {
+                completions.take(done);
+                for (Completion& r : done) {
+                    auto it = conns_.find(r.conn);
+                    if (it == conns_.end()) { // client already gone
+                        if (r.query) queries_.cancel(r.conn);
+                        continue;
+                    }
+                    Connection& c = it->second;
+                    c.out += r.text;
+                    if (r.last) --c.pending;
+                    if (r.query) {
+                        if (c.out.size() < MAX_OUTBUF) queries_.resume(r.conn);
+                        else c.queryWaits = true; // flush() resumes it
+                    }
+                    dirty_.push_back(r.conn);
+                }
+                done.clear();
+            } else {
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) onReadable(id);
+                if (events[i].events & EPOLLOUT) dirty_.push_back(id);
+            }
+        }
+
+        // one send per connection per loop turn, however many replies
+        std::vector<uint64_t> ids;
+        ids.swap(dirty_);
+        for (uint64_t id : ids) flush(id);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // ./logd [-s <socket>]
+    std::string socketPath = LOGD_SOCKET_PATH;
+    if (argc == 3 && std::string(argv[1]) == "-s") {
+        socketPath = argv[2];
+    } else if (argc != 1) {
+        std::cerr << "Usage: " << argv[0] << " [-s <socket>]\n";
+        return 2;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    ::pthread_sigmask(SIG_BLOCK, &mask, nullptr); // before any thread starts
+
+    auto server = std::make_unique<Server>();
+    if (!server->init(socketPath)) {
+        printSecureError("failed to start log service");
+        return 1;
+    }
+
+    std::cout << "Serving gallery log on " << socketPath << std::endl;
+    server->run();
+
+    // Destroying the server finishes queued appends; queries still being
+    // answered are dropped with their connections.
+    ::unlink(socketPath.c_str());
+    server.reset();
+    std::cout << "Log service stopped\n";
+    return 0;
+}
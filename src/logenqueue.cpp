@@ -0,0 +1,54 @@
+// logenqueue.cpp
+// -------------------------------------
+// Collector-side producer for the shared-memory event ring (see
+// event_ring.h): queues one event for logingest to append.
+//
+// responsibilities:
+// authenticate token with APPEND permission (EventProducer::open)
+// validate event, person and room like logappend
+// enqueue one event stamped with the token's actorId and digest
+// never touches the log: logingest checks the gallery rules and appends
+
+#include "security_utils.h"
+#include "event_ring.h"
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    // ./logenqueue -T <token> -E <event> -P <personId> -R <roomId>
+    std::string token, event, personId, roomId;
+    bool bad = argc != 9;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "-T")      token = argv[i + 1];
+        else if (arg == "-E") event = argv[i + 1];
+        else if (arg == "-P") personId = argv[i + 1];
+        else if (arg == "-R") roomId = argv[i + 1];
+        else bad = true;
+    }
+
+    Action action;
+    Room room;
+    if (bad || token.empty() || !parseAction(event, action) || !parseRoom(roomId, room) ||
+        !validatePersonId(personId)) {
+        std::cerr << "Usage: " << argv[0] << " -T <token> -E <event> -P <personId> -R <roomId>\n";
+        std::cerr << "Valid events: ENTER, MOVE, EXIT\n";
+        std::cerr << "Valid rooms: lobby, gallery1, gallery2, vault, security, storage, -\n";
+        return 2;
+    }
+
+    std::string error;
+    auto producer = EventProducer::open(token, &error);
+    if (!producer) {
+        printSecureError(error);
+        return 1;
+    }
+
+    if (!producer->submit(personId, action, room)) {
+        printSecureError("event ring is full");
+        return 1;
+    }
+
+    std::cout << "Queued event for logingest\n";
+    return 0;
+}
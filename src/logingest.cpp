@@ -0,0 +1,177 @@
+// logingest.cpp
+// -------------------------------------
+// Single consumer for the shared-memory event ring (see event_ring.h).
+//
+// responsibilities:
+// authenticate token with APPEND permission
+// create (or reattach to) the /dev/shm ring that collectors enqueue into;
+// refuse to start while another logingest consumes it
+// drain queued events in batches; skip slots abandoned by dead producers
+// check each event's producer token digest (see event_ring.h) against
+// the token store generation pinned for that batch
+// reload the token store on SIGHUP or when the store file changes
+// (inotify), so a revoked producer token stops working without a restart
+// per batch and segment (the log, or each shard): lock it like logappend,
+// recover a torn tail, replay only what other writers appended since the
+// last batch, enforce the gallery rules event by event and append all
+// accepted events with one durable write (see io_backend.h)
+// a batch whose write fails is kept and retried with backoff, so an
+// event taken off the ring is never dropped
+// rejected events are reported on stderr and never written
+
+#include "security_utils.h"
+#include "log_segment.h"
+#include "event_ring.h"
+#include "log_layout.h"
+#include "token_store.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+
+static constexpr size_t MAX_BATCH = 1024;
+
+static volatile std::sig_atomic_t stopRequested = 0;
+static volatile std::sig_atomic_t reloadRequested = 0;
+static void onStopSignal(int) { stopRequested = 1; }
+static void onReloadSignal(int) { reloadRequested = 1; }
+
+int main(int argc, char* argv[]) {
+    // ./logingest -T <token>
+    if (argc != 3 || std::string(argv[1]) != "-T") {
+        std::cerr << "Usage: " << argv[0] << " -T <token>\n";
+        return 2;
+    }
+
+    if (!authenticateToken(argv[2], Operation::Append, getTokenStore())) {
+        printSecureError("authentication failed");
+        return 1;
+    }
+
+    EventRing ring;
+    std::string error;
+    if (!ring.create(&error)) {
+        printSecureError(error);
+        return 1;
+    }
+
+    IdDictionary dict;
+    std::map<std::string, SegmentState> segments; // by segment path
+    if (!dict.load(ID_DICT_PATH)) {
+        printSecureError("failed to open ID dictionary");
+        return 1;
+    }
+
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+    std::signal(SIGHUP, onReloadSignal);
+    // Without inotify the store is still reloaded on SIGHUP.
+    TokenStoreWatch tokenWatch;
+    const bool watching = tokenWatch.start();
+
+    // batch holds every event dequeued but not written yet. A segment
+    // whose write fails keeps its events at the front of the next batch
+    // (in order, so per-person order holds) and is retried with backoff;
+    // an event leaves the batch only once it was appended or rejected.
+    std::vector<RingEvent> batch;
+    batch.reserve(MAX_BATCH);
+    unsigned long total = 0, abandoned = 0;
+    long idleNs = 0, retryNs = 0;
+
+    std::cout << "Ingesting events from shared memory ring..." << std::endl;
+
+    while (true) {
+        if (reloadRequested || (watching && tokenWatch.changed())) {
+            reloadRequested = 0;
+            std::string error;
+            if (reloadTokenStore(error)) std::cout << "Token store reloaded" << std::endl;
+            else printSecureError(error + "; keeping the current token store");
+        }
+
+        RingEvent ev;
+        while (batch.size() < MAX_BATCH && ring.tryDequeue(ev)) batch.push_back(ev);
+
+        if (batch.empty()) {
+            pid_t dead;
+            if (ring.skipAbandoned(dead)) {
+                std::cerr << "Lost event: producer " << dead << " died before publishing it\n";
+                ++abandoned;
+                continue;
+            }
+            if (stopRequested) break; // ring drained, nothing held
+            // idle: back off from 50us up to 5ms between polls
+            idleNs = idleNs ? std::min(idleNs * 2, 5000000L) : 50000L;
+            struct timespec ts = {0, idleNs};
+            ::nanosleep(&ts, nullptr);
+            continue;
+        }
+        idleNs = 0;
+
+        // One store generation for the whole batch: events held for a
+        // retry are checked again against whatever is current then.
+        const auto store = getTokenStore();
+
+        // Route events to their segment; all events of one person go to
+        // the same shard, so per-person order is kept.
+        std::vector<RingEvent> held;
+        LogLayout layout;
+        if (!loadLogLayout(layout)) {
+            printSecureError("failed to read shard manifest");
+            held.swap(batch);
+        }
+        std::map<std::string, std::vector<RingEvent>> bySegment;
+        for (const RingEvent& e : batch) {
+            bySegment[layout.pathFor(std::string_view(e.personId, std::min<size_t>(e.personLen, RING_ID_CAPACITY)))]
+                .push_back(e);
+        }
+
+        for (auto& [path, events] : bySegment) {
+            std::vector<LogEntry> entries;
+            std::vector<RingEvent> accepted;
+            entries.reserve(events.size());
+            accepted.reserve(events.size());
+            for (const RingEvent& ev : events) {
+                LogEntry e;
+                const std::string why = ringEventToEntry(ev, store, e);
+                if (why.empty()) {
+                    entries.push_back(std::move(e));
+                    accepted.push_back(ev);
+                } else {
+                    std::cerr << "Rejected event: " << why << "\n";
+                }
+            }
+
+            std::vector<std::string> verdicts;
+            long n = appendToSegment(path, dict, segments[path], entries, verdicts);
+            if (n < 0) { // nothing was written: keep the events for a retry
+                held.insert(held.end(), accepted.begin(), accepted.end());
+                continue;
+            }
+            for (const auto& v : verdicts) {
+                if (!v.empty()) std::cerr << "Rejected event: " << v << "\n";
+            }
+            total += static_cast<unsigned long>(n);
+        }
+
+        batch.swap(held);
+        if (batch.empty()) {
+            retryNs = 0;
+            continue;
+        }
+        // write failed (lock timeout, I/O error, manifest): back off from
+        // 1ms up to 1s, then retry the held events first
+        if (!retryNs) printSecureError("failed to append event batch; retrying");
+        retryNs = retryNs ? std::min(retryNs * 2, 1000000000L) : 1000000L;
+        struct timespec ts = {retryNs / 1000000000L, retryNs % 1000000000L};
+        ::nanosleep(&ts, nullptr);
+    }
+
+    std::cout << "Appended " << total << " events";
+    if (abandoned) std::cout << " (" << abandoned << " never published by dead producers)";
+    std::cout << "\n";
+    return 0;
+}
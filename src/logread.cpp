@@ -3,90 +3,204 @@
 // authenticated read-only tool for the secure gallery log.
 //
 // responsibilities:
-// authenticate token with proper permissions, READ
-// open fixed log file, read only
-// acquire shared read file lock
-// parse each line to build each log entry
-// print parsed entries
+// authenticate token (or session ticket) with proper permissions, READ
+// open fixed log file (or every shard, see log_layout.h), read only
+// take a shared lock on the append region just long enough to capture the
+// committed length, then lock and read only the range [0, committed)
+// parse each line to build each log entry (big logs and shards in
+// parallel on the shared thread pool, -j threads)
+// show the latest checkpoint (state folded in by logcompact), if any
+// merge shards by timestamp and print parsed entries
+// -R: print who is inside from the live state table (live_state.h) when
+// it is current: one room by its O(1) head count and per-person lookups,
+// all rooms from one snapshot; falling back to a replay
 // never modifies log, only reads
 
 #include "security_utils.h"
+#include "log_segment.h"
+#include "log_layout.h"
+#include "thread_pool.h"
+#include "live_state.h"
+#include "token_store.h"
+#include "session.h"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
 #include <vector>
-#include <cerrno>   // errno
-#include <cstring>  // strerror
-#include <unistd.h> 
+#include <sys/stat.h>
+
+// True when the table's marks match every segment on disk.
+static bool tableCurrent(const LiveSnapshot& snap, const LogLayout& layout,
+                         const std::vector<std::string>& paths) {
+    if (snap.shards != layout.shards || snap.segments.size() != paths.size()) return false;
+    for (size_t k = 0; k < paths.size(); ++k) {
+        struct stat st;
+        if (::stat(paths[k].c_str(), &st) != 0 || st.st_ino != snap.segments[k].inode ||
+            st.st_size != snap.segments[k].end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// One room from the table: the head count from occupancy(), the names by
+// asking roomOf() for each dictionary index. The marks are read again
+// afterwards; any publish in between sends the caller to the replay.
+static bool roomFromTable(const LiveStateTable& table, const LiveSnapshot& before,
+                          const IdDictionary& dict, Room room,
+                          std::vector<std::pair<std::string, Room>>& inside) {
+    uint32_t count = 0;
+    if (!table.occupancy(room, count)) return false;
+    for (uint32_t idx = 0; idx < dict.size() && idx < LIVE_STATE_CAPACITY; ++idx) {
+        Room r;
+        if (!table.roomOf(idx, r)) return false;
+        if (r == room) inside.emplace_back(dict.name(idx), r);
+    }
+    LiveSnapshot after;
+    if (!table.marks(after) || after.shards != before.shards) return false;
+    for (size_t k = 0; k < after.segments.size(); ++k) {
+        if (after.segments[k].inode != before.segments[k].inode ||
+            after.segments[k].end != before.segments[k].end) {
+            return false;
+        }
+    }
+    return inside.size() == count;
+}
+
+// Who is inside right now (room, or every room for Room::None): from the
+// live state table when its marks match every segment on disk, otherwise
+// by replaying the segments.
+static bool currentOccupancy(const LogLayout& layout, Room room,
+                             std::vector<std::pair<std::string, Room>>& inside,
+                             bool& fromTable) {
+    const std::vector<std::string> paths = layout.segmentPaths();
+
+    LiveStateTable table;
+    LiveSnapshot snap;
+    fromTable = table.attach() &&
+                (room == Room::None ? table.snapshot(snap) : table.marks(snap)) &&
+                tableCurrent(snap, layout, paths);
+
+    // Loaded after the snapshot: every index in it is already interned.
+    IdDictionary dict;
+    if (!dict.loadReadOnly(ID_DICT_PATH)) return false;
+
+    if (fromTable && room == Room::None) {
+        for (uint32_t idx = 0; idx < snap.rooms.size() && idx < dict.size(); ++idx) {
+            if (snap.rooms[idx]) inside.emplace_back(dict.name(idx), static_cast<Room>(snap.rooms[idx] - 1));
+        }
+        return true;
+    }
+    if (fromTable) {
+        if (roomFromTable(table, snap, dict, room, inside)) return true;
+        inside.clear();
+        fromTable = false;
+    }
+
+    for (const auto& path : paths) {
+        SegmentState live;
+        if (!refreshSegment(path, dict, live)) return false;
+        for (uint32_t idx = 0; idx < live.state.size(); ++idx) {
+            if (live.state[idx].inside() && (room == Room::None || live.state[idx].room() == room)) {
+                inside.emplace_back(dict.name(idx), live.state[idx].room());
+            }
+        }
+    }
+    return true;
+}
 
 int main(int argc, char* argv[]) {
-    //   ./logread -T <token> <logpath>
-     if (argc != 3 || std::string(argv[1]) != "-T") {
-        std::cerr << "Usage: " << argv[0] << " -T <token>\n";
+    //   ./logread -T <token>|-S <ticket> [-j <threads>] [-R <roomId|*>]
+    std::string token, ticket, roomArg;
+    bool bad = argc % 2 == 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "-T")      token = argv[i + 1];
+        else if (arg == "-S") ticket = argv[i + 1];
+        else if (arg == "-j") {
+            unsigned jobs = 0;
+            if (parseJobs(argv[i + 1], jobs)) setThreadPoolJobs(jobs);
+            else bad = true;
+        }
+        else if (arg == "-R") roomArg = argv[i + 1];
+        else bad = true;
+    }
+    Room room = Room::None; // None = every room
+    if (bad || token.empty() == ticket.empty() ||
+        (!roomArg.empty() && roomArg != "*" && (!parseRoom(roomArg, room) || room == Room::None))) {
+        std::cerr << "Usage: " << argv[0] << " -T <token>|-S <ticket> [-j <threads>] [-R <roomId|*>]\n";
         return 2; // argument error
     }
 
-    std::string token   = argv[2];
     std::string logPath = LOG_FILE_PATH;
 
-    // Authenticate token for READ operation.
-    const auto& store = getBuiltInTokenStore();
-    const UserTokenInfo* user =
-        authenticateToken(token, Operation::Read, store);
+    // Authenticate token (or session ticket) for READ operation.
+    UserTokenInfo session;
+    const auto store = getTokenStore(); // keeps user valid
+    const UserTokenInfo* user = ticket.empty()
+        ? authenticateToken(token, Operation::Read, store)
+        : (authenticateSession(ticket, Operation::Read, session) ? &session : nullptr);
 
     if (!user) {
         printSecureError("authentication failed");
         return 1;
     }
 
-    // Open the log file (read-only).
-    int fd = openFileRO(logPath);
-    if (fd < 0) {
-        // If file doesn't exist yet, treat as empty log/state.
-        if (errno == ENOENT) {
-            std::cout << "No log file found at '" << logPath
-                      << "'. Assuming empty gallery state.\n";
-            return 0; // not an error; just no events yet
-        }
-
-        // Any other error is a real failure.
-        printSecureError("failed to open log file for reading");
+    LogLayout layout;
+    if (!loadLogLayout(layout)) {
+        printSecureError("failed to read shard manifest");
         return 1;
     }
 
-     std::cout << "Accessing log file..." << std::endl;
+    if (!roomArg.empty()) {
+        std::vector<std::pair<std::string, Room>> inside;
+        bool fromTable = false;
+        if (!currentOccupancy(layout, room, inside, fromTable)) {
+            printSecureError("failed to read current state");
+            return 1;
+        }
+        std::sort(inside.begin(), inside.end());
+
+        std::cout << "Current occupancy (" << (fromTable ? "live state table" : "log replay") << "):\n";
+        for (size_t r = 0; r < LIVE_ROOM_COUNT; ++r) {
+            if (room != Room::None && static_cast<size_t>(room) != r) continue;
+            size_t count = 0;
+            for (const auto& p : inside) count += static_cast<size_t>(p.second) == r;
+            if (room == Room::None && count == 0) continue;
+
+            std::cout << roomName(static_cast<Room>(r)) << ": " << count << "\n";
+            for (const auto& p : inside) {
+                if (static_cast<size_t>(p.second) == r) std::cout << "  " << p.first << "\n";
+            }
+        }
+        return 0;
+    }
 
-    // Acquire shared (reader) lock.
-    if (!lockFile(fd, false)) {
-        printSecureError("failed to acquire shared read lock on log file");
-        ::close(fd);
+    std::vector<SegmentData> segments;
+    std::string error;
+    if (!readSegments(layout.segmentPaths(), segments, error)) {
+        printSecureError(error);
         return 1;
     }
 
-    // Use an input stream to read lines.
-    std::ifstream in(logPath);
-    if (!in.is_open()) {
-        printSecureError("failed to open input stream for log file");
-        unlockFile(fd);
-        ::close(fd);
-        return 1;
+    if (!layout.sharded() && !segments[0].found) {
+        std::cout << "No log file found at '" << logPath
+                  << "'. Assuming empty gallery state.\n";
+        return 0; // not an error; just no events yet
     }
 
-    std::vector<LogEntry> entries;
-    std::string line;
+     std::cout << "Accessing log file..." << std::endl;
 
-    // Read file line by line and parse into LogEntry.
-    while (std::getline(in, line)) {
-        LogEntry e;
-        if (parseLogLine(line, e)) {
-            entries.push_back(e);
-        } else {
-            // Malformed lines are treated as untrusted and skipped.
-        }
+    // History before the checkpoint lives in logs/archive/
+    for (const auto& seg : segments) {
+        if (seg.ckptTimestamp < 0) continue;
+        std::cout << "Checkpoint " << formatTimestamp(seg.ckptTimestamp) << ": "
+                  << seg.checkpoints.size() << " people inside\n";
+        for (const auto& c : seg.checkpoints) std::cout << c << "\n";
     }
 
-     in.close();
-    unlockFile(fd);
-    ::close(fd);
+    std::vector<LogEntry> entries = layout.sharded() ? mergeByTimestamp(segments)
+                                                     : std::move(segments[0].entries);
 
     if (entries.empty()) {
         std::cout << "Log file exists but contains no valid entries.\n";
@@ -94,14 +208,15 @@ int main(int argc, char* argv[]) {
     }
 
     std::cout << "Parsed " << entries.size() << " log entries:\n";
+    char ts[MAX_TIMESTAMP_CHARS];
     for (const auto& e : entries) {
         // print out log entries
-        std::cout << e.timestamp << " | "
+        std::cout << std::string_view(ts, formatTimestamp(e.timestamp, ts) - ts) << " | "
                   << e.actorId   << " | "
                   << e.personId  << " | "
-                  << e.action    << " | "
-                  << e.roomId    << "\n";
+                  << actionName(e.action) << " | "
+                  << roomName(e.room)     << "\n";
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,71 @@
+// logsession.cpp
+// -------------------------------------
+// Exchanges a token for a short-lived session ticket (see session.h).
+//
+// responsibilities:
+// authenticate the token (any permission; the ticket carries it)
+// print a ticket valid for -t seconds (default 300, at most 900)
+// -r: rotate the session key, ending every outstanding ticket; needs
+// both READ and APPEND permission (admin)
+
+#include "security_utils.h"
+#include "session.h"
+#include "token_store.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    // ./logsession -T <token> [-t <seconds>]
+    // ./logsession -T <token> -r
+    std::string token, ttlArg;
+    bool rotate = false, bad = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-T" && i + 1 < argc)      token = argv[++i];
+        else if (arg == "-t" && i + 1 < argc) ttlArg = argv[++i];
+        else if (arg == "-r")                 rotate = true;
+        else bad = true;
+    }
+
+    int64_t ttl = SESSION_DEFAULT_TTL;
+    if (!ttlArg.empty()) {
+        char* end = nullptr;
+        ttl = std::strtoll(ttlArg.c_str(), &end, 10);
+        if (*end || ttl < 1 || ttl > SESSION_MAX_TTL) bad = true;
+    }
+    if (bad || token.empty() || (rotate && !ttlArg.empty())) {
+        std::cerr << "Usage: " << argv[0] << " -T <token> [-t <seconds>]\n"
+                  << "       " << argv[0] << " -T <token> -r\n"
+                  << "Ticket lifetime: 1.." << SESSION_MAX_TTL << " seconds (default "
+                  << SESSION_DEFAULT_TTL << ")\n";
+        return 2;
+    }
+
+    const auto& store = getTokenStore();
+    const UserTokenInfo* reader = authenticateToken(token, Operation::Read, store);
+    const UserTokenInfo* appender = authenticateToken(token, Operation::Append, store);
+    const UserTokenInfo* user = reader ? reader : appender;
+    if (!user || (rotate && !(reader && appender))) {
+        printSecureError("authentication failed");
+        return 1;
+    }
+
+    std::string error;
+    if (rotate) {
+        if (!rotateSessionKey(error)) {
+            printSecureError(error);
+            return 1;
+        }
+        std::cout << "Session key rotated; all issued tickets are revoked\n";
+        return 0;
+    }
+
+    std::string ticket;
+    if (!issueSessionTicket(*user, ttl, ticket, error)) {
+        printSecureError(error);
+        return 1;
+    }
+    std::cout << ticket << "\n";
+    return 0;
+}
@@ -0,0 +1,207 @@
+// logshard.cpp
+// -------------------------------------
+// Authenticated one-way switch from the single log file to the
+// hash-sharded layout (see log_layout.h).
+//
+// responsibilities:
+// authenticate token with both READ and APPEND permission
+// take an exclusive whole-file lock on logs/gallery.log
+// replay it into the current inside/room map
+// create every shard file, each starting with a checkpoint of the people
+// that hash to it
+// hard-link the old log into logs/archive/, hand the live state table
+// the new layout, publish the manifest, then unlink logs/gallery.log
+//
+// Writers blocked on the old log notice it is gone after taking the lock
+// (isCurrentFile), reload the layout and reopen their shard.
+
+#include "security_utils.h"
+#include "id_dictionary.h"
+#include "gallery_state.h"
+#include "log_layout.h"
+#include "live_state.h"
+#include "token_store.h"
+#include <iostream>
+#include <string>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const std::string ARCHIVE_DIR = "logs/archive";
+
+// fsync a directory so renames/links in it are durable
+static void syncDir(const std::string& dir) {
+    int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        (void)::fsync(dfd);
+        ::close(dfd);
+    }
+}
+
+// Create a shard file holding only data, durably. Fails if it exists.
+static bool writeNewFile(const std::string& path, const std::string& data) {
+    int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (out < 0) return false;
+    ssize_t written = ::write(out, data.data(), data.size());
+    bool ok = written == static_cast<ssize_t>(data.size()) && ::fsync(out) == 0;
+    ::close(out);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    // ./logshard -T <token> -n <shards>
+    if (argc != 5 || std::string(argv[1]) != "-T" || std::string(argv[3]) != "-n") {
+        std::cerr << "Usage: " << argv[0] << " -T <token> -n <shards>\n";
+        return 2;
+    }
+
+    char* end = nullptr;
+    unsigned long shards = std::strtoul(argv[4], &end, 10);
+    if (*argv[4] == '\0' || *end != '\0' || shards < 2 || shards > MAX_SHARDS) {
+        std::cerr << "Error: shard count must be between 2 and " << MAX_SHARDS << "\n";
+        return 2;
+    }
+
+    // Sharding rewrites which files are active, so require both operations.
+    const auto& store = getTokenStore();
+    const UserTokenInfo* user =
+        authenticateToken(argv[2], Operation::Append, store);
+
+    if (!user || !permissionAllows(user->permission, Operation::Read)) {
+        printSecureError("authentication failed");
+        return 1;
+    }
+
+    LogLayout layout;
+    if (!loadLogLayout(layout)) {
+        printSecureError("failed to read shard manifest");
+        return 1;
+    }
+    if (layout.sharded()) {
+        std::cerr << "Error: log is already sharded (" << layout.shards << " shards)\n";
+        return 2;
+    }
+
+    const std::string logPath = LOG_FILE_PATH;
+
+    // Lock the single log (creating it if there are no events yet) so no
+    // append can land while the shards are built.
+    int fd = -1;
+    LockStats lockStats("shard");
+    while (true) {
+        fd = openFileAppend(logPath);
+        if (fd < 0) {
+            printSecureError("failed to open log file");
+            return 1;
+        }
+        if (!lockFile(fd, true, &lockStats)) {
+            printSecureError(errno == ETIMEDOUT
+                                 ? "timed out waiting for exclusive lock on log file"
+                                 : "failed to acquire exclusive write lock on log file");
+            ::close(fd);
+            return 1;
+        }
+        if (isCurrentFile(fd, logPath)) break;
+        unlockFile(fd, &lockStats);
+        ::close(fd);
+    }
+
+    auto fail = [&](const std::string& msg) {
+        printSecureError(msg);
+        unlockFile(fd, &lockStats);
+        ::close(fd);
+        return 1;
+    };
+
+    // Checked again under the lock: a second logshard waits above, then
+    // finds the manifest written by the first one.
+    if (!loadLogLayout(layout)) return fail("failed to read shard manifest");
+    if (layout.sharded()) {
+        unlockFile(fd, &lockStats);
+        ::close(fd);
+        std::cerr << "Error: log is already sharded (" << layout.shards << " shards)\n";
+        return 2;
+    }
+
+    if (recoverLogTail(fd, logPath) == TailRecovery::Failed) {
+        return fail("failed to recover torn log tail");
+    }
+
+    IdDictionary dict;
+    if (!dict.load(ID_DICT_PATH)) return fail("failed to open ID dictionary");
+
+    StateTable state;
+    if (!replayLog(fd, dict, state)) return fail("failed to replay log file");
+
+    if (::mkdir(ARCHIVE_DIR.c_str(), 0700) != 0 && errno != EEXIST) {
+        return fail("failed to create archive directory");
+    }
+
+    // Shard files left behind by an earlier interrupted run were never
+    // published (no manifest), so they hold nothing live.
+    const int64_t timestamp = getCurrentTimestamp();
+    for (unsigned k = 0; k < shards; ++k) {
+        const std::string path = shardPath(k);
+        ::unlink(path.c_str());
+
+        StateTable part(state.size());
+        for (uint32_t idx = 0; idx < state.size(); ++idx) {
+            if (state[idx].inside() && shardFor(dict.name(idx), shards) == k) part[idx] = state[idx];
+        }
+        if (!writeNewFile(path, formatCheckpoint(part, dict, timestamp))) {
+            return fail("failed to create shard file");
+        }
+    }
+
+    // Keep the old log in the archive (same naming as logcompact).
+    const std::string stamp = formatTimestamp(timestamp);
+    std::string archivePath = ARCHIVE_DIR + "/gallery." + stamp + ".log";
+    struct stat st;
+    for (int n = 1; ::stat(archivePath.c_str(), &st) == 0; ++n) {
+        archivePath = ARCHIVE_DIR + "/gallery." + stamp + ".log." + std::to_string(n);
+    }
+    if (::link(logPath.c_str(), archivePath.c_str()) != 0) {
+        return fail("failed to archive old log file");
+    }
+    syncDir(ARCHIVE_DIR);
+
+    // Give the live state table the new layout before any writer can
+    // reach a shard (best effort, like every other publisher).
+    LiveStateTable live;
+    if (live.create()) {
+        LogLayout next;
+        next.shards = shards;
+        std::vector<LiveSegmentMark> marks(shards);
+        bool ok = true;
+        for (unsigned k = 0; k < shards && ok; ++k) {
+            ok = ::stat(shardPath(k).c_str(), &st) == 0;
+            marks[k].inode = st.st_ino;
+            marks[k].end = st.st_size;
+        }
+        if (ok) live.publishAll(next, marks, state);
+    }
+
+    // Publishing the manifest is the switch-over point. A crash before it
+    // leaves the single log active; a crash after it leaves a stale
+    // gallery.log that no tool reads any more.
+    const std::string tmpManifest = SHARD_MANIFEST_PATH + ".tmp";
+    ::unlink(tmpManifest.c_str());
+    if (!writeNewFile(tmpManifest, "shards=" + std::to_string(shards) + "\n") ||
+        ::rename(tmpManifest.c_str(), SHARD_MANIFEST_PATH.c_str()) != 0) {
+        ::unlink(tmpManifest.c_str());
+        return fail("failed to write shard manifest");
+    }
+    ::unlink(logPath.c_str());
+    syncDir("logs");
+
+    unlockFile(fd, &lockStats);
+    ::close(fd);
+
+    size_t inside = 0;
+    for (const auto& ps : state) inside += ps.inside();
+    std::cout << "Sharded log into " << shards << " files: " << inside
+              << " people inside at checkpoint " << stamp << "\n";
+    return 0;
+}
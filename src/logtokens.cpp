@@ -0,0 +1,115 @@
+// logtokens.cpp
+// -------------------------------------
+// Authenticated builder for the token store file (see token_store.h).
+//
+// responsibilities:
+// authenticate token with both READ and APPEND permission (admin)
+// read "<actorId> <ReadOnly|AppendOnly|ReadWrite> <sha256-hex>" lines
+// (blank lines and # comments skipped); only digests, never tokens
+// reject malformed lines, invalid actor IDs and duplicate digests
+// write the table to a new 0600 file and rename it over the store, so
+// processes that already mapped the old store keep a consistent view
+// (resident ones such as logd then reload it on their own)
+
+#include "security_utils.h"
+#include "token_store.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+static bool parsePermission(const std::string& s, Permission& out) {
+    if (s == "ReadOnly")   { out = Permission::ReadOnly;   return true; }
+    if (s == "AppendOnly") { out = Permission::AppendOnly; return true; }
+    if (s == "ReadWrite")  { out = Permission::ReadWrite;  return true; }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    // ./logtokens -T <token> -i <input> [-o <store>]
+    std::string token, inPath;
+    std::string outPath = tokenStorePath();
+    bool bad = argc % 2 == 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "-T")      token = argv[i + 1];
+        else if (arg == "-i") inPath = argv[i + 1];
+        else if (arg == "-o") outPath = argv[i + 1];
+        else bad = true;
+    }
+    if (bad || token.empty() || inPath.empty()) {
+        std::cerr << "Usage: " << argv[0] << " -T <token> -i <input> [-o <store>]\n";
+        return 2;
+    }
+
+    // Issuing tokens is an admin operation: require READ and APPEND.
+    const auto& store = getTokenStore();
+    if (!authenticateToken(token, Operation::Read, store) ||
+        !authenticateToken(token, Operation::Append, store)) {
+        printSecureError("authentication failed");
+        return 1;
+    }
+
+    std::ifstream in(inPath);
+    if (!in) {
+        printSecureError("failed to open input file");
+        return 1;
+    }
+
+    std::vector<UserTokenInfo> users;
+    std::string line;
+    for (size_t lineNo = 1; std::getline(in, line); ++lineNo) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string actorId, permission, hash, extra;
+        UserTokenInfo user;
+        if (!(fields >> actorId >> permission >> hash) || (fields >> extra) ||
+            !parsePermission(permission, user.permission) || !digestFromHex(hash, user.tokenHash)) {
+            std::cerr << "Error: malformed line " << lineNo << "\n";
+            return 2;
+        }
+        user.actorId.assign(actorId); // too long leaves it empty: rejected as invalid below
+        users.push_back(std::move(user));
+    }
+
+    std::vector<uint8_t> table;
+    std::string error;
+    if (!buildTokenTable(users, table, error)) {
+        std::cerr << "Error: " << error << "\n";
+        return 2;
+    }
+
+    const std::string tmpPath = outPath + ".tmp";
+    ::unlink(tmpPath.c_str());
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        printSecureError("failed to create token store");
+        return 1;
+    }
+    size_t done = 0;
+    while (done < table.size()) {
+        ssize_t n = ::write(fd, table.data() + done, table.size() - done);
+        if (n <= 0) break;
+        done += static_cast<size_t>(n);
+    }
+    bool ok = done == table.size() && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || std::rename(tmpPath.c_str(), outPath.c_str()) != 0) {
+        ::unlink(tmpPath.c_str());
+        printSecureError("failed to write token store");
+        return 1;
+    }
+
+    TokenStoreHeader h;
+    std::memcpy(&h, table.data(), sizeof(h));
+    std::cout << "Wrote " << users.size() << " tokens to " << outPath << " (" << h.bucketCount
+              << " buckets, probe limit " << h.probeLimit << ")\n";
+    return 0;
+}
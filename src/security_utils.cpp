@@ -8,67 +8,50 @@
 // permession checks, READ and APPEND
 // input validation for rooms, person and guess IDs, and events
 // log entry formatting and parsing
-// secure file open, append, and locking to perform actions
+// secure file open, append, and byte-range locking to perform actions
 // 
 // logread and logappend both use helpers
 
 #include "security_utils.h"
-#include <openssl/sha.h>
+#include "io_backend.h"
+#include "text_scan.h"
 #include <vector>
 #include <string>
-#include <cctype>          // std::isalnum
-#include <unordered_set>   // room whitelist
-#include <sys/file.h>      // flock
+#include <cerrno>          // EINTR, program_invocation_short_name
+#include <cstdlib>         // getenv, strtol
+#include <cstring>         // strcmp
+#include <charconv>        // from_chars, to_chars
+#include <ctime>           // nanosleep
+#include <algorithm>       // std::min
 #include <sys/stat.h>      // file modes
-#include <fcntl.h>         // open flags
+#include <fcntl.h>         // open flags, OFD locks
 #include <unistd.h>        // open/close
 #include <iostream>        // printSecureError
 #include <cstdio>          // FILE*, fprintf
+#include <chrono>          // getCurrentTimestamp
 
-// convert raw bytes -> loewcase hex string
-static std::string toHex(const unsigned char* data, size_t len) {
-    static const char* HEX = "0123456789abcdef";
-    std::string out; out.resize(len * 2); // pre-allocate output buffer
+// Computes SHA-256 hash of token
+Digest sha256Digest(std::string_view s) {
+    Digest digest;
 
-    //convert each byte into 2 hex characters
-    for (size_t i = 0; i < len; ++i) {
-        unsigned char b = data[i];
-        out[2*i] = HEX[(b >> 4) & 0x0F];
-        out[2*i+1] = HEX[b & 0x0F];
-    }
-    return out;
-}
+    thread_local Sha256 hasher; // context reused by every call on this thread
+    hasher.digest(s.data(), s.size(), digest);
 
-// Computes SHA-256 hash of token and converts to hex representation
-std::string sha256Hex(const std::string& s) {
-    unsigned char digest[SHA256_DIGEST_LENGTH]; // digest the hashing data into hex
-
-    SHA256_CTX ctx; // hashing context (internal state)
-    SHA256_Init(&ctx); // start hashing
-    SHA256_Update(&ctx, s.data(), s.size()); // feed input bytes
-    SHA256_Final(digest, &ctx); // finalize hash into digest
-
-    return toHex(digest, SHA256_DIGEST_LENGTH); // return hex represenatation
+    return digest;
 }
 
-bool constantTimeEquals(const std::string& a, const std::string& b) {
-    if (a.size() != b.size()) return false;
-
-    unsigned char diff = 0;
-
-    // XOR every character so timing is identical regardless of mismatch position
-    for (size_t i = 0; i < a.size(); ++i) {
-        diff |= (unsigned char)(a[i] ^ b[i]);
-    }
-    return diff == 0; // Only equal if XOR of all bytes is zero
+static Digest hexDigest(std::string_view hex) {
+    Digest d{};
+    digestFromHex(hex, d);
+    return d;
 }
 
 // Store of user's tokens and their permissions
 // hash value, actual password not hardcoded
 static const std::vector<UserTokenInfo> BUILT_IN_STORE = {
-    {"guard_alex",  Permission::AppendOnly, "e45703ec0bf6e9b29fec9e4819f33c7c8a302d93eccef0f7bddd57c80c93f5a0"},
-    {"manager_kim", Permission::ReadOnly,   "12ae512c7eeda74af4e625e1fe2888645c434586d24b75ea3302d3d75d121130"},
-    {"admin_lee",   Permission::ReadWrite,  "f929608275fa3fa111110583af685764f71a1ddc67dd2af65284e35eceb583ad"}
+    {GalleryId("guard_alex"),  Permission::AppendOnly, hexDigest("e45703ec0bf6e9b29fec9e4819f33c7c8a302d93eccef0f7bddd57c80c93f5a0")},
+    {GalleryId("manager_kim"), Permission::ReadOnly,   hexDigest("12ae512c7eeda74af4e625e1fe2888645c434586d24b75ea3302d3d75d121130")},
+    {GalleryId("admin_lee"),   Permission::ReadWrite,  hexDigest("f929608275fa3fa111110583af685764f71a1ddc67dd2af65284e35eceb583ad")}
 };
 
 // Returns the built-in hash table of authorized users.
@@ -96,7 +79,7 @@ const UserTokenInfo* authenticateToken(const std::string& providedToken,
         return nullptr;  // Empty tokens are automatically invalid
 
     // Hash user's provided plaintext token
-    const std::string providedHash = sha256Hex(providedToken);
+    const Digest providedHash = sha256Digest(providedToken);
 
     // Scan all known users
     for (const auto& user : store) {
@@ -117,135 +100,185 @@ const UserTokenInfo* authenticateToken(const std::string& providedToken,
 }
 
 // Used for actorId and personId.
-static bool validIdLike(const std::string& s) {
-    if (s.empty() || s.size() > 32) return false;   // enforce size bound
-
-    for (char c : s) {
-        // allowed: letters, digits, underscore, dash
-        if (!(std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-')) {
-            return false;
-        }
-    }
-    return true;
+static bool validIdLike(std::string_view s) {
+    // enforce size bound; allowed: letters, digits, underscore, dash
+    return !s.empty() && s.size() <= MAX_ID_LENGTH && allIdChars(s);
 }
 
 // Only allow the 3 valid actions we support.
 bool validateAction(const std::string& action) {
-    return (action == "ENTER" ||
-            action == "MOVE"  ||
-            action == "EXIT");
+    Action a;
+    return parseAction(action, a);
 }
 
-// allows valid rooms in the gallery
+// allows valid rooms in the gallery ("-" is used for EXIT events)
 bool validateRoomId(const std::string& room) {
-    static const std::unordered_set<std::string> ROOMS = {
-        "lobby",
-        "gallery1",
-        "gallery2",
-        "vault",
-        "security",
-        "storage",
-        "-"        // used for EXIT events
-    };
-
-    return ROOMS.find(room) != ROOMS.end();
+    Room r;
+    return parseRoom(room, r);
 }
 
 // Validate person ID (guest/employee IDs).
-bool validatePersonId(const std::string& id) {
+bool validatePersonId(std::string_view id) {
     return validIdLike(id);
 }
 
-// Validate timestamp parsed from log file.
-bool validateTimestamp(const std::string& ts) {
-    if (ts.empty() || ts.size() > 11) return false; // 10–11 digits typical for epoch
+TimestampResolution timestampResolution() {
+    static const TimestampResolution resolution = [] {
+        const char* env = std::getenv("GALLERYLOG_TIME");
+        if (env && std::strcmp(env, "ms") == 0) return TimestampResolution::Millis;
+        if (env && std::strcmp(env, "us") == 0) return TimestampResolution::Micros;
+        return TimestampResolution::Seconds;
+    }();
+    return resolution;
+}
 
-    for (char c : ts) {
-        if (!std::isdigit(static_cast<unsigned char>(c))) {
-            return false;
-        }
+// Current time in microseconds, cut to the configured resolution.
+int64_t getCurrentTimestamp() {
+    const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    switch (timestampResolution()) {
+        case TimestampResolution::Micros: return us;
+        case TimestampResolution::Millis: return us - us % 1000;
+        default:                          return us - us % TIMESTAMP_UNITS_PER_SECOND;
     }
+}
+
+// Validate and convert a timestamp parsed from the log file.
+bool parseTimestamp(std::string_view s, int64_t& out) {
+    const char* p = s.data();
+    const char* end = p + s.size();
+    // from_chars would accept a sign
+    if (s.empty() || *p < '0' || *p > '9') return false;
+
+    int64_t secs = 0;
+    auto res = std::from_chars(p, std::min(end, p + 11), secs); // 10–11 digits typical for epoch
+    if (res.ec != std::errc()) return false;
+    int64_t value = secs * TIMESTAMP_UNITS_PER_SECOND;
+
+    if (res.ptr != end) {
+        // '.' and exactly 3 or 6 more digits
+        const char* frac = res.ptr + 1;
+        const ptrdiff_t digits = end - frac;
+        if (*res.ptr != '.' || (digits != 3 && digits != 6) || *frac < '0' || *frac > '9') return false;
+        uint32_t fraction = 0;
+        res = std::from_chars(frac, end, fraction);
+        if (res.ec != std::errc() || res.ptr != end) return false;
+        value += digits == 3 ? fraction * 1000 : fraction;
+    }
+    out = value;
     return true;
 }
 
-// Simple splitter by a single character delimiter.
-static std::vector<std::string> split(const std::string& s, char delim) {
-    std::vector<std::string> out;
-    std::string cur;
+// Shortest exact form: no fraction, milliseconds, or microseconds.
+char* formatTimestamp(int64_t ts, char* out) {
+    char* end = std::to_chars(out, out + 11, ts / TIMESTAMP_UNITS_PER_SECOND).ptr;
+    int64_t frac = ts % TIMESTAMP_UNITS_PER_SECOND;
+    if (frac == 0) return end;
+
+    // 1000 + ms or 1000000 + us keeps the leading zeros; the 1 becomes the dot
+    const int64_t shown = frac % 1000 == 0 ? 1000 + frac / 1000 : TIMESTAMP_UNITS_PER_SECOND + frac;
+    char* fracEnd = std::to_chars(end, end + 7, shown).ptr;
+    *end = '.';
+    return fracEnd;
+}
 
-    for (char c : s) {
-        if (c == delim) {
-            out.push_back(cur);
-            cur.clear();
-        } else {
-            cur.push_back(c);
-        }
-    }
-    out.push_back(cur);
-    return out;
+std::string formatTimestamp(int64_t ts) {
+    char buf[MAX_TIMESTAMP_CHARS];
+    return std::string(buf, formatTimestamp(ts, buf));
 }
 
 // Produce the canonical on-disk log format for one entry:
 // timestamp|actorId|personId|action|roomId\n
-std::string formatLogEntry(const LogEntry& e) {
-    std::string line;
-
-    line.reserve(e.timestamp.size() +
-                 e.actorId.size() +
-                 e.personId.size() +
-                 e.action.size() +
-                 e.roomId.size() +
-                 5); // 4 '|' + '\n'
-
-    line.append(e.timestamp);
-    line.push_back('|');
-    line.append(e.actorId);
-    line.push_back('|');
-    line.append(e.personId);
-    line.push_back('|');
-    line.append(e.action);
-    line.push_back('|');
-    line.append(e.roomId);
-    line.push_back('\n');
+char* formatLogEntry(const LogEntry& e, char* out) {
+    auto put = [&](std::string_view field, char sep) {
+        std::memcpy(out, field.data(), field.size());
+        out += field.size();
+        *out++ = sep;
+    };
+    out = formatTimestamp(e.timestamp, out);
+    *out++ = '|';
+    put(e.actorId, '|');
+    put(e.personId, '|');
+    put(actionName(e.action), '|');
+    put(roomName(e.room), '\n');
+    return out;
+}
 
-    return line;
+std::string formatLogEntry(const LogEntry& e) {
+    char buf[MAX_LOG_LINE_CHARS];
+    return std::string(buf, formatLogEntry(e, buf));
 }
 
+// Longest valid line is 18 + 32 + 32 + 5 + 8 + 4 separators = 99 bytes
+// (MAX_LOG_LINE_CHARS without the '\n').
+static_assert(MAX_LOG_LINE_CHARS - 1 <= MAX_SCANNED_LINE,
+              "a valid log line must fit the scanned masks");
+
 // Parse a single line from the log file into a LogEntry.
 // Returns true if the line is well-formed and passes validation.
-bool parseLogLine(const std::string& line, LogEntry& out) {
-    // Make a copy so we can strip newline characters.
-    std::string s = line;
+bool parseLogLine(std::string_view line, LogEntry& out) {
+    if (line.size() > MAX_SCANNED_LINE + 2) return false; // \r\n at most on top
+    LineMasks masks;
+    scanLine(line, masks);
+    return parseLogLine(line, masks, out);
+}
 
-    // Trim trailing \r and \n (handles Windows + Unix newlines).
+// The separators come out of the '|' mask and the ID fields are
+// validated by checking their bit ranges against the ID-character mask,
+// so no byte is looked at twice.
+bool parseLogLine(std::string_view line, const LineMasks& masks, LogEntry& out) {
+    std::string_view s = line;
+
+    // Trim trailing \r and \n (handles Windows + Unix newlines); they are
+    // in neither mask below, so the masks need no trimming.
     while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) {
-        s.pop_back();
+        s.remove_suffix(1);
     }
-
-    auto parts = split(s, '|');
-    if (parts.size() != 5) {
-        return false; // wrong number of fields
+    if (s.empty() || s.size() > MAX_SCANNED_LINE) return false;
+
+    // Exactly four separators, lowest first.
+    const ScanMasks* m = masks.part;
+    size_t bars[4];
+    size_t n = 0;
+    for (size_t half = 0; half < 2; ++half) {
+        for (uint64_t b = m[half].bar; b; b &= b - 1) {
+            if (n == 4) return false; // too many fields
+            bars[n++] = half * SCAN_BLOCK + static_cast<size_t>(__builtin_ctzll(b));
+        }
     }
+    if (n != 4 || bars[0] > MAX_TIMESTAMP_CHARS) return false; // too few fields
 
-    const std::string& ts   = parts[0];
-    const std::string& aid  = parts[1];
-    const std::string& pid  = parts[2];
-    const std::string& act  = parts[3];
-    const std::string& room = parts[4];
+    // After the timestamp every byte is an ID character or a separator
+    // (action and room names are too); parseTimestamp checks the rest.
+    const size_t firstLen = std::min(s.size(), SCAN_BLOCK);
+    if ((m[0].idChar | m[0].bar | lowBits(bars[0])) != lowBits(firstLen) ||
+        (m[1].idChar | m[1].bar) != lowBits(s.size() - firstLen)) {
+        return false;
+    }
 
-    // Validate each field independently.
-    if (!validateTimestamp(ts))   return false;
-    if (!validIdLike(aid))        return false; // actorId uses same rules as IDs
-    if (!validatePersonId(pid))   return false;
-    if (!validateAction(act))     return false;
-    if (!validateRoomId(room))    return false;
+    std::string_view ts   = s.substr(0, bars[0]);
+    std::string_view aid  = s.substr(bars[0] + 1, bars[1] - bars[0] - 1);
+    std::string_view pid  = s.substr(bars[1] + 1, bars[2] - bars[1] - 1);
+    std::string_view act  = s.substr(bars[2] + 1, bars[3] - bars[2] - 1);
+    std::string_view room = s.substr(bars[3] + 1);
+
+    // Validate each field independently; the ID character classes are
+    // already known, so only lengths and the names remain.
+    int64_t timestamp;
+    if (!parseTimestamp(ts, timestamp)) return false;
+    if (aid.empty() || aid.size() > MAX_ID_LENGTH) return false; // actorId uses same rules as IDs
+    if (pid.empty() || pid.size() > MAX_ID_LENGTH) return false;
+    Action action;
+    Room roomCode;
+    if (!parseAction(act, action)) return false;
+    if (!parseRoom(room, roomCode)) return false;
 
     // Fill the output struct.
-    out.timestamp = ts;
-    out.actorId   = aid;
-    out.personId  = pid;
-    out.action    = act;
-    out.roomId    = room;
+    out.timestamp = timestamp;
+    out.actorId.assign(aid);
+    out.personId.assign(pid);
+    out.action    = action;
+    out.room      = roomCode;
 
     return true;
 }
@@ -265,31 +298,268 @@ int openFileRO(const std::string& path) {
 
 // Open file for append-only writes, creating it if necessary.
 // Permissions: 0600 (owner read/write only).
+// Read access lets the writer replay through the same descriptor it locked;
+// O_APPEND still forces every write to the end of the file.
 int openFileAppend(const std::string& path) {
     int fd = ::open(path.c_str(),
-                    O_WRONLY | O_CREAT | O_APPEND,
+                    O_RDWR | O_CREAT | O_APPEND,
                     0600); // owner rw, no permissions for others
     return fd;
 }
 
-// Acquire a file lock using flock().
-// exclusive = true  -> LOCK_EX (writer lock)
-// exclusive = false -> LOCK_SH (shared reader lock)
-//
-// Returns true on success, false on failure.
-bool lockFile(int fd, bool exclusive) {
+static int64_t steadyNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static LockOptions loadLockOptions() {
+    LockOptions opts;
+    if (const char* env = std::getenv("GALLERYLOG_LOCK_TIMEOUT_MS")) {
+        char* end = nullptr;
+        long v = std::strtol(env, &end, 10);
+        if (end != env && *end == '\0') opts.timeoutMs = static_cast<int>(v);
+    }
+    return opts;
+}
+
+static LockOptions& lockOptionsStorage() {
+    static LockOptions opts = loadLockOptions();
+    return opts;
+}
+
+void setLockOptions(const LockOptions& opts) { lockOptionsStorage() = opts; }
+const LockOptions& lockOptions() { return lockOptionsStorage(); }
+
+// Appends one telemetry record with a single write(), so records from
+// concurrent processes never interleave within a line.
+void emitLockStats(const LockStats& st, const char* result) {
+    static const char* sink = std::getenv("GALLERYLOG_LOCK_STATS");
+    if (!sink || !*sink) return;
+
+    std::string line = "lockstats|";
+    line += program_invocation_short_name;
+    line += '|';
+    line += st.name;
+    line += "|wait_us=" + std::to_string(st.waitUs);
+    line += "|hold_us=" + std::to_string(st.holdUs);
+    line += "|retries=" + std::to_string(st.retries);
+    line += "|result=";
+    line += result;
+    line += '\n';
+
+    if (std::string(sink) == "stderr") {
+        (void)::write(STDERR_FILENO, line.data(), line.size());
+        return;
+    }
+    int fd = ::open(sink, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (fd >= 0) {
+        (void)::write(fd, line.data(), line.size());
+        ::close(fd);
+    }
+}
+
+// Byte-range locks use fcntl() open file description (OFD) locks: like
+// flock() they belong to the open file, not the process, and are released
+// on close, but they cover a byte range instead of the whole file.
+static bool setRangeLock(int fd, short type, off_t start, off_t len, LockStats* stats) {
+    struct flock fl{};
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len; // 0 = through the end of the file and beyond
+    fl.l_pid = 0;   // required for OFD locks
+
+    if (type == F_UNLCK) {
+        (void)::fcntl(fd, F_OFD_SETLK, &fl);
+        if (stats) {
+            stats->holdUs = static_cast<uint64_t>(steadyNowUs() - stats->acquiredAtUs);
+            emitLockStats(*stats, "ok");
+        }
+        return true;
+    }
+
+    const int timeoutMs = lockOptions().timeoutMs;
+    const int64_t startUs = steadyNowUs();
+    int64_t backoffUs = 100;
+    unsigned retries = 0;
+    bool ok = false;
+    const char* result = "error";
+
+    while (true) {
+        // Blocking mode waits in the kernel; otherwise poll with backoff.
+        if (::fcntl(fd, timeoutMs < 0 ? F_OFD_SETLKW : F_OFD_SETLK, &fl) == 0) {
+            ok = true;
+            result = "ok";
+            break;
+        }
+        if (errno == EINTR) continue; // a signal is not a lock failure
+        if (errno != EAGAIN && errno != EACCES) break;
+
+        const int64_t elapsedUs = steadyNowUs() - startUs;
+        const int64_t remainingUs = static_cast<int64_t>(timeoutMs) * 1000 - elapsedUs;
+        if (remainingUs <= 0) {
+            result = "timeout";
+            break;
+        }
+
+        struct timespec ts;
+        const int64_t sleepUs = std::min(backoffUs, remainingUs);
+        ts.tv_sec = sleepUs / 1000000;
+        ts.tv_nsec = (sleepUs % 1000000) * 1000;
+        ::nanosleep(&ts, nullptr);
+        backoffUs = std::min<int64_t>(backoffUs * 2, 50000); // cap at 50ms
+        ++retries;
+    }
+
+    const int64_t nowUs = steadyNowUs();
+    if (stats) {
+        stats->waitUs = static_cast<uint64_t>(nowUs - startUs);
+        stats->retries = retries;
+        stats->acquiredAtUs = nowUs;
+        if (!ok) emitLockStats(*stats, result);
+    }
+    if (!ok && std::string(result) == "timeout") errno = ETIMEDOUT;
+    return ok;
+}
+
+bool lockRange(int fd, off_t start, off_t len, bool exclusive, LockStats* stats) {
     if (fd < 0) return false;
+    return setRangeLock(fd, exclusive ? F_WRLCK : F_RDLCK, start, len, stats);
+}
 
-    int op = exclusive ? LOCK_EX : LOCK_SH;
-    if (::flock(fd, op) != 0) {
-        return false;
+void unlockRange(int fd, off_t start, off_t len, LockStats* stats) {
+    if (fd >= 0) {
+        (void)setRangeLock(fd, F_UNLCK, start, len, stats);
     }
-    return true;
+}
+
+// Writers serialize on one byte far past any real data, so an append
+// never conflicts with a reader scanning committed history.
+bool lockAppendRegion(int fd, bool exclusive, LockStats* stats) {
+    return lockRange(fd, APPEND_LOCK_OFFSET, 1, exclusive, stats);
+}
+
+void unlockAppendRegion(int fd, LockStats* stats) {
+    unlockRange(fd, APPEND_LOCK_OFFSET, 1, stats);
+}
+
+// Acquire a whole-file lock (byte range 0..infinity).
+// exclusive = true  -> writer lock, also excludes appenders and readers
+// exclusive = false -> shared reader lock
+//
+// Returns true on success, false on failure (errno = ETIMEDOUT on timeout).
+bool lockFile(int fd, bool exclusive, LockStats* stats) {
+    return lockRange(fd, 0, 0, exclusive, stats);
 }
 
 // Release a file lock previously acquired with lockFile().
-void unlockFile(int fd) {
-    if (fd >= 0) {
-        (void)::flock(fd, LOCK_UN);
+void unlockFile(int fd, LockStats* stats) {
+    unlockRange(fd, 0, 0, stats);
+}
+
+// Returns true if fd still refers to the file currently linked at path.
+// logcompact swaps in a new active segment with rename(), so a process that
+// opened the old segment before it got the lock must reopen and retry.
+bool isCurrentFile(int fd, const std::string& path) {
+    struct stat fdStat, pathStat;
+    if (::fstat(fd, &fdStat) != 0) return false;
+    if (::stat(path.c_str(), &pathStat) != 0) return false;
+    return fdStat.st_dev == pathStat.st_dev && fdStat.st_ino == pathStat.st_ino;
+}
+
+// Offset just past the last '\n' before size (0 if there is none), or -1
+// on a read error. Reads backwards in small blocks, so the cost is bounded
+// by the length of the last line rather than the file.
+static off_t lastLineStart(int fd, off_t size) {
+    char buf[4096];
+    for (off_t end = size; end > 0; ) {
+        off_t start = end > static_cast<off_t>(sizeof(buf)) ? end - static_cast<off_t>(sizeof(buf)) : 0;
+        ssize_t n = ::pread(fd, buf, static_cast<size_t>(end - start), start);
+        if (n != end - start) return -1;
+        for (ssize_t i = n - 1; i >= 0; --i) {
+            if (buf[i] == '\n') return start + i + 1;
+        }
+        end = start;
+    }
+    return 0;
+}
+
+// Writers only grow the file while holding the exclusive lock, so the size
+// seen under any lock is a committed length. Rounding down to the last
+// '\n' also drops a torn line that recovery has not cleaned up yet.
+off_t committedLength(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) return -1;
+    return lastLineStart(fd, st.st_size);
+}
+
+// Scans backwards from EOF to the last '\n' (never reading more than the
+// torn line itself), then:
+//  - if the fragment is a complete, valid event that only lost its '\n',
+//    terminate it so the event is kept. The last field (room) has no valid
+//    proper prefix, so a parseable fragment cannot be a cut-off record.
+//  - otherwise copy it to <logPath>.quarantine and truncate the log back to
+//    the end of the last complete record. Those bytes were never committed.
+TailRecovery recoverLogTail(int fd, const std::string& logPath) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) return TailRecovery::Failed;
+    const off_t size = st.st_size;
+    if (size == 0) return TailRecovery::Clean;
+
+    char last;
+    if (::pread(fd, &last, 1, size - 1) != 1) return TailRecovery::Failed;
+    if (last == '\n') return TailRecovery::Clean;
+
+    // find the start of the torn line
+    const off_t lineStart = lastLineStart(fd, size);
+    if (lineStart < 0) return TailRecovery::Failed;
+
+    std::string fragment(static_cast<size_t>(size - lineStart), '\0');
+    if (::pread(fd, &fragment[0], fragment.size(), lineStart) != static_cast<ssize_t>(fragment.size())) {
+        return TailRecovery::Failed;
+    }
+
+    LogEntry e;
+    if (parseLogLine(fragment, e)) {
+        if (::write(fd, "\n", 1) != 1 || ::fdatasync(fd) != 0) return TailRecovery::Failed;
+        return TailRecovery::Terminated;
     }
+
+    // Keep the fragment for inspection before cutting it off.
+    const std::string quarantinePath = logPath + ".quarantine";
+    int q = ::open(quarantinePath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (q < 0) return TailRecovery::Failed;
+
+    std::string record = "offset " + std::to_string(lineStart) +
+                         " length " + std::to_string(fragment.size()) + "\n" +
+                         fragment + "\n";
+    bool saved = ::write(q, record.data(), record.size()) == static_cast<ssize_t>(record.size()) &&
+                 ::fsync(q) == 0;
+    ::close(q);
+    if (!saved) return TailRecovery::Failed;
+
+    if (::ftruncate(fd, lineStart) != 0 || ::fdatasync(fd) != 0) return TailRecovery::Failed;
+    return TailRecovery::Quarantined;
+}
+
+// Buffered line reader over a raw fd; the chunks come from the I/O
+// backend (see io_backend.h).
+// A final line without a trailing '\n' is still delivered, like getline().
+bool forEachLine(int fd, off_t start, off_t end,
+                 const std::function<void(std::string_view, const LineMasks&)>& fn) {
+    std::string buf;
+    bool ok = readChunks(fd, start, end, 64 * 1024, [&](const char* chunk, size_t n) {
+        buf.append(chunk, n);
+
+        // hand out every complete line, keep the remainder for the next read
+        buf.erase(0, forEachScannedLine(buf.data(), buf.size(), fn));
+    });
+    if (!ok) return false;
+
+    if (!buf.empty()) {
+        LineMasks masks;
+        scanLine(buf, masks);
+        fn(buf, masks);
+    }
+    return true;
 }
\ No newline at end of file
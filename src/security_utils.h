@@ -6,8 +6,21 @@
 #ifndef SECURITY_UTILS_H
 #define SECURITY_UTILS_H
 
+#include "fixed_id.h"
+#include "hashing.h"
+#include "text_scan.h"
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
+#include <sys/types.h>
+
+// Actor and person IDs: 1..MAX_ID_LENGTH ID characters, held inline.
+inline constexpr size_t MAX_ID_LENGTH = 32;
+using GalleryId = FixedId<MAX_ID_LENGTH>;
 
 // Tokens & Authentication
 
@@ -15,14 +28,13 @@ enum class Operation { Read , Append};
 enum class Permission { ReadOnly , AppendOnly , ReadWrite};
 
 struct UserTokenInfo {
-    std::string actorId; // ID of user
+    GalleryId actorId; // ID of user
     Permission permission; // ReadOnly | AppendOnly | ReadWrite
-    std::string tokenHash; // hash of user's token
+    Digest tokenHash; // SHA-256 of user's token
 };
 
 
-std::string sha256Hex(const std::string& s); // hashing tokens
-bool constantTimeEquals(const std::string& a, const std::string& b); //compare hashes
+Digest sha256Digest(std::string_view s); // hashing tokens (compare with constantTimeEquals)
 
 const std::vector<UserTokenInfo>& getBuiltInTokenStore(); // retrieves data of all stored tokens
 bool permissionAllows(Permission p, Operation op); // checks if user permission allows use of selected operation
@@ -30,33 +42,165 @@ bool permissionAllows(Permission p, Operation op); // checks if user permission
 const UserTokenInfo* authenticateToken(const std::string& providedToken, 
     Operation requiredOp, const std::vector<UserTokenInfo>& store);
 
+// Actions and rooms as compact codes.
+// Name tables are constexpr and indexed by the enum value, so parsing and
+// formatting never hash or build strings.
+enum class Action : uint8_t { Enter, Move, Exit };
+enum class Room : uint8_t { Lobby, Gallery1, Gallery2, Vault, Security, Storage, None }; // None = "-" (EXIT)
+
+inline constexpr std::string_view ACTION_NAMES[] = { "ENTER", "MOVE", "EXIT" };
+inline constexpr std::string_view ROOM_NAMES[] = {
+    "lobby", "gallery1", "gallery2", "vault", "security", "storage", "-"
+};
+
+constexpr std::string_view actionName(Action a) { return ACTION_NAMES[static_cast<uint8_t>(a)]; }
+constexpr std::string_view roomName(Room r)     { return ROOM_NAMES[static_cast<uint8_t>(r)]; }
+
+// Perfect hash on length (plus one distinguishing byte), then a single
+// compare against the table entry to confirm the match.
+constexpr bool parseAction(std::string_view s, Action& out) {
+    Action a = Action::Enter;
+    switch (s.size()) {
+        case 5: a = Action::Enter; break;
+        case 4: a = (s[0] == 'M') ? Action::Move : Action::Exit; break;
+        default: return false;
+    }
+    if (s != actionName(a)) return false;
+    out = a;
+    return true;
+}
+
+constexpr bool parseRoom(std::string_view s, Room& out) {
+    Room r = Room::None;
+    switch (s.size()) {
+        case 1: r = Room::None; break;
+        case 5: r = (s[0] == 'l') ? Room::Lobby : Room::Vault; break;
+        case 7: r = Room::Storage; break;
+        case 8:
+            if (s[0] == 's')       r = Room::Security;
+            else if (s[7] == '1')  r = Room::Gallery1;
+            else                   r = Room::Gallery2;
+            break;
+        default: return false;
+    }
+    if (s != roomName(r)) return false;
+    out = r;
+    return true;
+}
+
+// Timestamps are microseconds since the Unix epoch. The log writes them
+// as seconds plus a fraction only when there is one, so logs written at
+// 1-second resolution keep their old form and order correctly against
+// finer ones:
+//   1700000000   1700000000.250   1700000000.250001
+inline constexpr int64_t TIMESTAMP_UNITS_PER_SECOND = 1000000;
+inline constexpr int64_t MAX_TIMESTAMP = 99999999999 * TIMESTAMP_UNITS_PER_SECOND + 999999;
+inline constexpr size_t  MAX_TIMESTAMP_CHARS = 11 + 1 + 6;
+
+// Resolution of getCurrentTimestamp(), from GALLERYLOG_TIME (s, ms, us).
+enum class TimestampResolution { Seconds, Millis, Micros };
+TimestampResolution timestampResolution();
+
 // Represents a single validated log entry in memory.
 // Matches on-disk format: timestamp|actorId|personId|action|roomId
+// Trivially copyable: no heap storage, copies are memcpy.
 struct LogEntry {
-    std::string timestamp; // Unix epoch as string
-    std::string actorId;   // who appended (from authenticated token)
-    std::string personId;  // subject of the event
-    std::string action;    // ENTER | MOVE | EXIT
-    std::string roomId;    // room name or "-" for EXIT
+    int64_t timestamp = 0; // microseconds since the Unix epoch
+    GalleryId actorId;     // who appended (from authenticated token)
+    GalleryId personId;    // subject of the event
+    Action action;         // ENTER | MOVE | EXIT
+    Room room;             // room, or Room::None ("-") for EXIT
 };
+static_assert(std::is_trivially_copyable_v<LogEntry>, "LogEntry is copied as bytes");
 
 // Validation helpers
 bool validateAction(const std::string& action);
 bool validateRoomId(const std::string& room);
-bool validatePersonId(const std::string& id);
-bool validateTimestamp(const std::string& ts);
+bool validatePersonId(std::string_view id);
 
 // Log formatting & parsing
+int64_t getCurrentTimestamp();      // now, truncated to timestampResolution()
+// Up to 11 digits of seconds, then optionally '.' and 3 or 6 digits.
+bool parseTimestamp(std::string_view s, int64_t& out);
+// ts must be in [0, MAX_TIMESTAMP]. Writes at most MAX_TIMESTAMP_CHARS
+// characters; returns the end.
+char* formatTimestamp(int64_t ts, char* out);
+std::string formatTimestamp(int64_t ts);
+// Longest formatted entry: timestamp, two IDs, "ENTER", "security" (the
+// longest room name), four '|' and '\n'.
+inline constexpr size_t MAX_LOG_LINE_CHARS = MAX_TIMESTAMP_CHARS + 2 * MAX_ID_LENGTH + 5 + 8 + 5;
+// Writes the entry's line, '\n' included, to out (at least
+// MAX_LOG_LINE_CHARS bytes) and returns the end; per-line callers use
+// this one to stay off the heap.
+char* formatLogEntry(const LogEntry& e, char* out);
 std::string formatLogEntry(const LogEntry& e);
-bool parseLogLine(const std::string& line, LogEntry& out);
+bool parseLogLine(std::string_view line, LogEntry& out);
+// Same, with the line's masks already computed (text_scan.h), e.g. by
+// forEachLine.
+bool parseLogLine(std::string_view line, const LineMasks& masks, LogEntry& out);
 
 // Error reporting
 void printSecureError(const std::string& msg);
 
+// Lock acquisition policy, shared by every lock call in the process.
+// timeoutMs < 0 blocks until the lock is free; 0 is a single non-blocking
+// try; > 0 retries with exponential backoff until the deadline, then
+// fails with errno = ETIMEDOUT. Defaults come from GALLERYLOG_LOCK_TIMEOUT_MS.
+struct LockOptions {
+    int timeoutMs = -1;
+};
+void setLockOptions(const LockOptions& opts);
+const LockOptions& lockOptions();
+
+// Per-call lock telemetry. Pass one to a lock call and the matching unlock
+// call; the unlock (or a failed lock) emits a record to the stats sink
+// named by GALLERYLOG_LOCK_STATS (a file path, or "stderr"):
+//   lockstats|<tool>|<lock>|wait_us=N|hold_us=N|retries=N|result=ok|timeout|error
+struct LockStats {
+    explicit LockStats(const char* lockName) : name(lockName) {}
+    const char* name;
+    uint64_t waitUs = 0;
+    uint64_t holdUs = 0;
+    unsigned retries = 0;
+    int64_t acquiredAtUs = 0; // steady clock, set when the lock is granted
+};
+void emitLockStats(const LockStats& st, const char* result);
+
 // File open + locking
 inline const std::string LOG_FILE_PATH = "logs/gallery.log";
 int  openFileRO(const std::string& path);      // open read-only, return fd or -1
 int  openFileAppend(const std::string& path);  // open append-only, 0600 perms
-bool lockFile(int fd, bool exclusive);         // true = LOCK_EX, false = LOCK_SH
-void unlockFile(int fd);
+bool lockFile(int fd, bool exclusive, LockStats* stats = nullptr); // whole file; true = exclusive
+void unlockFile(int fd, LockStats* stats = nullptr);
+
+// Byte-range locks (fcntl OFD locks, so they do not mix with flock()).
+// Appenders lock only the append region, readers only the range they
+// scan, so queries over history and appends run in parallel. lockFile()
+// covers every range and is used where the whole file must be quiet
+// (logcompact swapping segments, the ID dictionary).
+inline constexpr off_t APPEND_LOCK_OFFSET = std::numeric_limits<off_t>::max() - 1;
+bool lockRange(int fd, off_t start, off_t len, bool exclusive,
+               LockStats* stats = nullptr);                  // len 0 = to infinity
+void unlockRange(int fd, off_t start, off_t len, LockStats* stats = nullptr);
+bool lockAppendRegion(int fd, bool exclusive,               // exclusive for writers,
+                      LockStats* stats = nullptr);          // shared to wait for a commit
+void unlockAppendRegion(int fd, LockStats* stats = nullptr);
+bool isCurrentFile(int fd, const std::string& path); // fd still names the file at path
+
+// Crash recovery for the active log (caller holds the exclusive lock).
+// Records are '\n'-terminated lines written with a single write(), so a
+// writer that died mid-write leaves at most one unterminated last line.
+enum class TailRecovery { Clean, Terminated, Quarantined, Failed };
+TailRecovery recoverLogTail(int fd, const std::string& logPath);
+
+// Length of the log up to the end of its last complete line.
+// Take it under a brief lock; everything before it is immutable, so the
+// bytes can then be read without holding any lock. Returns -1 on error.
+off_t committedLength(int fd);
+
+// Calls fn for every line of fd in [start, end) (newline stripped), with
+// its byte-class masks; end < 0 reads to EOF. Returns false on a read
+// error.
+bool forEachLine(int fd, off_t start, off_t end,
+                 const std::function<void(std::string_view, const LineMasks&)>& fn);
 #endif // SECURITY_UTILS_H
\ No newline at end of file
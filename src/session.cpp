@@ -0,0 +1,149 @@
+// session.{h,cpp}
+// -------------------------------------
+// HMAC-signed session tickets.
+//
+// responsibilities:
+// create, load and rotate the session key (regular file, ours, 0600)
+// issue tickets with a bounded lifetime
+// validate tickets: MAC first (constant-time), then the claims it covers
+
+#include "session.h"
+#include "hashing.h"
+#include <openssl/crypto.h>  // OPENSSL_cleanse
+#include <openssl/rand.h>    // RAND_bytes
+#include <cerrno>
+#include <charconv>          // from_chars
+#include <cstdio>            // rename
+#include <ctime>             // time
+#include <memory>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool readKey(Digest& key, std::string& error) {
+    int fd = ::open(SESSION_KEY_PATH.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        error = errno == ENOENT ? "no session key" : "cannot open session key";
+        return false;
+    }
+
+    // Whoever can read the key can mint tickets for any actor.
+    struct stat st;
+    bool ok = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == ::geteuid() &&
+              (st.st_mode & 077) == 0 && st.st_size == static_cast<off_t>(key.size());
+    ok = ok && ::read(fd, key.data(), key.size()) == static_cast<ssize_t>(key.size());
+    ::close(fd);
+    if (!ok) error = "session key must be a 32-byte regular file owned by us with mode 0600";
+    return ok;
+}
+
+// Writes a fresh key next to the final path, then links it in (only if
+// there is none yet) or renames it over the old one.
+static bool writeKey(bool replace, std::string& error) {
+    Digest key;
+    if (RAND_bytes(key.data(), static_cast<int>(key.size())) != 1) {
+        error = "no randomness for session key";
+        return false;
+    }
+
+    const std::string tmp = SESSION_KEY_PATH + ".tmp." + std::to_string(::getpid());
+    ::unlink(tmp.c_str());
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    bool ok = fd >= 0 && ::write(fd, key.data(), key.size()) == static_cast<ssize_t>(key.size()) &&
+              ::fsync(fd) == 0;
+    if (fd >= 0) ::close(fd);
+    OPENSSL_cleanse(key.data(), key.size());
+
+    if (ok) {
+        if (replace) ok = std::rename(tmp.c_str(), SESSION_KEY_PATH.c_str()) == 0;
+        else ok = ::link(tmp.c_str(), SESSION_KEY_PATH.c_str()) == 0 || errno == EEXIST; // lost a race: keep theirs
+    }
+    ::unlink(tmp.c_str());
+    if (!ok) error = "failed to write session key";
+    return ok;
+}
+
+// The keyed MAC this process signs and checks with; the key is read once
+// and only its pad states are kept.
+static HmacSha256* sessionMac(bool create, std::string& error) {
+    static std::unique_ptr<HmacSha256> mac;
+    if (mac) return mac.get();
+
+    Digest key;
+    if (!readKey(key, error)) {
+        if (!create || error != "no session key" || !writeKey(false, error) || !readKey(key, error)) {
+            return nullptr;
+        }
+    }
+    mac = std::make_unique<HmacSha256>(key);
+    OPENSSL_cleanse(key.data(), key.size());
+    return mac.get();
+}
+
+bool issueSessionTicket(const UserTokenInfo& user, int64_t ttl, std::string& ticket,
+                        std::string& error) {
+    if (ttl < 1 || ttl > SESSION_MAX_TTL) {
+        error = "session lifetime must be 1.." + std::to_string(SESSION_MAX_TTL) + " seconds";
+        return false;
+    }
+    HmacSha256* mac = sessionMac(true, error);
+    if (!mac) return false;
+
+    const int64_t expiry = static_cast<int64_t>(std::time(nullptr)) + ttl;
+    std::string claims = SESSION_TICKET_PREFIX + "." + user.actorId.str() + "." +
+                         std::to_string(static_cast<int>(user.permission)) + "." + std::to_string(expiry);
+    Digest digest;
+    mac->mac(claims, digest);
+    ticket = claims + "." + digestToHex(digest);
+    return true;
+}
+
+bool rotateSessionKey(std::string& error) {
+    return writeKey(true, error);
+}
+
+bool authenticateSession(const std::string& ticket, Operation op, UserTokenInfo& user) {
+    // prefix . actor (<= 32) . code . expiry . 64 hex
+    if (ticket.size() > SESSION_TICKET_PREFIX.size() + 32 + 20 + 64 + 4) return false;
+    const size_t macDot = ticket.rfind('.');
+    if (macDot == std::string::npos) return false;
+    const std::string_view claims(ticket.data(), macDot);
+
+    Digest given, expected;
+    std::string error;
+    HmacSha256* mac = sessionMac(false, error);
+    if (!mac || !digestFromHex(std::string_view(ticket).substr(macDot + 1), given)) return false;
+    mac->mac(claims, expected);
+    if (!constantTimeEquals(given, expected)) return false;
+
+    // Signed by us, so well formed unless the key leaked; check anyway.
+    const size_t d1 = claims.find('.');
+    const size_t d2 = claims.find('.', d1 + 1);
+    const size_t d3 = claims.find('.', d2 + 1);
+    if (d1 == std::string_view::npos || d2 == std::string_view::npos || d3 == std::string_view::npos ||
+        claims.substr(0, d1) != SESSION_TICKET_PREFIX || d3 != d2 + 2) {
+        return false;
+    }
+    const std::string_view actorId = claims.substr(d1 + 1, d2 - d1 - 1);
+    const int code = claims[d2 + 1] - '0';
+    int64_t expiry = 0;
+    const std::string_view exp = claims.substr(d3 + 1);
+    auto [end, ec] = std::from_chars(exp.data(), exp.data() + exp.size(), expiry);
+    if (ec != std::errc() || end != exp.data() + exp.size() || code < 0 ||
+        code > static_cast<int>(Permission::ReadWrite) || !validatePersonId(actorId)) {
+        return false;
+    }
+
+    // Expired, or further away than any ticket we issue (clock stepped back).
+    const int64_t now = static_cast<int64_t>(std::time(nullptr));
+    if (expiry <= now || expiry - now > SESSION_MAX_TTL) return false;
+
+    const Permission permission = static_cast<Permission>(code);
+    if (!permissionAllows(permission, op)) return false;
+
+    user.actorId.assign(actorId);
+    user.permission = permission;
+    user.tokenHash = Digest{};
+    return true;
+}
@@ -0,0 +1,49 @@
+// session.{h,cpp}
+// -------------------------------------
+// Short-lived session tickets, so a kiosk that appends many times pays
+// for token authentication once.
+//
+// logsession exchanges a token for a ticket:
+//
+//   glsess1.<actorId>.<permission code>.<expiry (unix seconds)>.<mac>
+//
+// where mac is the hex HMAC-SHA256 of everything before it, keyed with
+// the 32 random bytes in logs/session.key (0600, created on first use).
+// Validating a ticket is one HMAC over ~60 bytes plus a constant-time
+// compare; the token store is not consulted.
+//
+// Revocation is bounded by the ticket lifetime: at most
+// SESSION_MAX_TTL seconds after a token is removed from the store, none
+// of the tickets it produced is accepted any more. Rotating the key
+// (logsession -r) ends every outstanding ticket at once.
+//
+// The key is read once per process and kept only as HMAC pad states. The
+// functions below are meant for the single-threaded command-line tools.
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "security_utils.h"
+#include <cstdint>
+#include <string>
+
+inline const std::string SESSION_KEY_PATH = "logs/session.key";
+inline const std::string SESSION_TICKET_PREFIX = "glsess1";
+
+inline constexpr int64_t SESSION_DEFAULT_TTL = 300; // seconds
+inline constexpr int64_t SESSION_MAX_TTL = 900;
+
+// Issues a ticket for an authenticated user, valid for ttl seconds
+// (1..SESSION_MAX_TTL). Creates the key file if there is none.
+bool issueSessionTicket(const UserTokenInfo& user, int64_t ttl, std::string& ticket,
+                        std::string& error);
+
+// Replaces the key with a fresh one; every ticket issued so far stops
+// validating.
+bool rotateSessionKey(std::string& error);
+
+// Checks the MAC and expiry and that the ticket's permission allows op.
+// On success fills user (tokenHash is left zero: tickets carry none).
+bool authenticateSession(const std::string& ticket, Operation op, UserTokenInfo& user);
+
+#endif // SESSION_H
@@ -102,6 +102,336 @@ int main() {
         "./logread -T lee-admin-789"
     );
 
+    // 8) Compaction keeps state across the segment boundary
+    std::system("rm -f logs/gallery.log");
+    std::system("rm -rf logs/archive");
+    runCommand(
+        "Test 8.1: ENTER emp007 into lobby",
+        "./logappend -T alex-write-123 -E ENTER -P emp007 -R lobby"
+    );
+    runCommand(
+        "Test 8.2: Compact with APPEND-ONLY token (should FAIL)",
+        "./logcompact -T alex-write-123"
+    );
+    runCommand(
+        "Test 8.3: Compact with READWRITE admin",
+        "./logcompact -T lee-admin-789"
+    );
+    runCommand(
+        "Test 8.4: MOVE emp007 after compaction (state from checkpoint)",
+        "./logappend -T alex-write-123 -E MOVE -P emp007 -R gallery1"
+    );
+    runCommand(
+        "Test 8.5: Second ENTER after compaction (should FAIL)",
+        "./logappend -T alex-write-123 -E ENTER -P emp007 -R lobby"
+    );
+    runCommand(
+        "Test 8.6: logread shows checkpoint and new entries",
+        "./logread -T lee-admin-789"
+    );
+
+    // 9) Torn last line from a crashed writer
+    std::system("rm -f logs/gallery.log logs/gallery.log.quarantine");
+    runCommand(
+        "Test 9.1: ENTER emp008 into lobby",
+        "./logappend -T alex-write-123 -E ENTER -P emp008 -R lobby"
+    );
+    runCommand(
+        "Test 9.2: Simulate a write torn mid-record",
+        "printf '1700000000|guard_alex|emp008|MOVE|gall' >> logs/gallery.log"
+    );
+    runCommand(
+        "Test 9.3: MOVE emp008 to vault (fragment quarantined, should SUCCEED)",
+        "./logappend -T alex-write-123 -E MOVE -P emp008 -R vault"
+    );
+    runCommand(
+        "Test 9.4: Simulate a write that lost only its newline",
+        "printf '1700000000|guard_alex|emp008|EXIT|-' >> logs/gallery.log"
+    );
+    runCommand(
+        "Test 9.5: EXIT emp008 again (recovered EXIT kept, should FAIL)",
+        "./logappend -T alex-write-123 -E EXIT -P emp008 -R -"
+    );
+
+    // 10) Hash-sharded layout
+    std::system("rm -f logs/gallery.log logs/gallery.manifest logs/gallery.*.log");
+    runCommand(
+        "Test 10.1: ENTER emp009 into lobby (single log)",
+        "./logappend -T alex-write-123 -E ENTER -P emp009 -R lobby"
+    );
+    runCommand(
+        "Test 10.2: Shard with APPEND-ONLY token (should FAIL)",
+        "./logshard -T alex-write-123 -n 4"
+    );
+    runCommand(
+        "Test 10.3: Shard into 4 files with READWRITE admin",
+        "./logshard -T lee-admin-789 -n 4"
+    );
+    runCommand(
+        "Test 10.4: Shard again (already sharded, should FAIL)",
+        "./logshard -T lee-admin-789 -n 8"
+    );
+    runCommand(
+        "Test 10.5: MOVE emp009 after sharding (state from shard checkpoint)",
+        "./logappend -T alex-write-123 -E MOVE -P emp009 -R gallery2"
+    );
+    runCommand(
+        "Test 10.6: ENTER emp010 into lobby",
+        "./logappend -T alex-write-123 -E ENTER -P emp010 -R lobby"
+    );
+    runCommand(
+        "Test 10.7: Second ENTER emp009 (should FAIL)",
+        "./logappend -T alex-write-123 -E ENTER -P emp009 -R lobby"
+    );
+    runCommand(
+        "Test 10.8: logread merges every shard by timestamp",
+        "./logread -T lee-admin-789"
+    );
+    runCommand(
+        "Test 10.9: logread reads shards on 2 pool threads (same output)",
+        "./logread -T lee-admin-789 -j 2"
+    );
+    runCommand(
+        "Test 10.10: logread with a malformed -j value (should FAIL)",
+        "./logread -T lee-admin-789 -j abc"
+    );
+    runCommand(
+        "Test 10.11: logread with a negative -j value (should FAIL)",
+        "./logread -T lee-admin-789 -j -1"
+    );
+    runCommand(
+        "Test 10.12: logread with an unknown flag (should FAIL)",
+        "./logread -T lee-admin-789 -x 2"
+    );
+    std::system("rm -f logs/gallery.manifest logs/gallery.*.log");
+
+    std::system("./logd > /dev/null 2>&1 & sleep 1");
+    runCommand(
+        "Test 11.1: ENTER emp011 through logd",
+        "./logclient -T alex-write-123 -E ENTER -P emp011 -R vault"
+    );
+    runCommand(
+        "Test 11.2: Second ENTER emp011 through logd (should FAIL)",
+        "./logclient -T alex-write-123 -E ENTER -P emp011 -R lobby"
+    );
+    runCommand(
+        "Test 11.3: Query through logd with APPEND-ONLY token (should FAIL)",
+        "./logclient -T alex-write-123 -Q emp011"
+    );
+    runCommand(
+        "Test 11.4: Query emp011 through logd with READ token",
+        "./logclient -T kim-read-456 -Q emp011"
+    );
+    runCommand(
+        "Test 11.5: 200 pipelined coroutines through one connection",
+        "./logclient -T alex-write-123 -n 200 > /dev/null"
+    );
+    std::system("pkill -TERM -x logd; sleep 1");
+    runCommand(
+        "Test 11.6: logclient with no logd running (should FAIL)",
+        "./logclient -T kim-read-456 -Q '*'"
+    );
+    runCommand(
+        "Test 11.7: Who is in the vault (live state table)",
+        "./logread -T kim-read-456 -R vault | grep 'live state table'"
+    );
+    runCommand(
+        "Test 11.8: Occupancy with APPEND-ONLY token (should FAIL)",
+        "./logread -T alex-write-123 -R vault"
+    );
+    runCommand(
+        "Test 11.9: Occupancy of '-' (not a room, should FAIL)",
+        "./logread -T kim-read-456 -R -"
+    );
+    runCommand(
+        "Test 11.10: Occupancy replay leaves the ID dictionary alone",
+        "printf \"$(date +%s)|guard_alex|emp099|ENTER|lobby\\n$(date +%s)|guard_alex|emp099|EXIT|-\\n\" >> logs/gallery.log &&"
+        " ./logread -T kim-read-456 -R '*' | grep 'log replay' && ! grep -x emp099 logs/gallery.ids"
+    );
+
+    // 12) Token store file
+    std::system("{ echo \"kiosk_001 AppendOnly $(printf kiosk-001 | sha256sum | cut -d' ' -f1)\";"
+                " echo \"admin_lee ReadWrite $(printf lee-admin-789 | sha256sum | cut -d' ' -f1)\"; }"
+                " > logs/tokens.txt");
+    runCommand(
+        "Test 12.1: Build token store with APPEND-ONLY token (should FAIL)",
+        "./logtokens -T alex-write-123 -i logs/tokens.txt"
+    );
+    runCommand(
+        "Test 12.2: Build token store with READWRITE admin",
+        "./logtokens -T lee-admin-789 -i logs/tokens.txt"
+    );
+    runCommand(
+        "Test 12.3: ENTER emp012 with a kiosk token from the store",
+        "./logappend -T kiosk-001 -E ENTER -P emp012 -R lobby"
+    );
+    runCommand(
+        "Test 12.4: Built-in token not in the store (should FAIL)",
+        "./logappend -T alex-write-123 -E EXIT -P emp012 -R -"
+    );
+    runCommand(
+        "Test 12.5: Store readable by others (should FAIL)",
+        "chmod 644 logs/gallery.tokens && ./logread -T lee-admin-789"
+    );
+    std::system("chmod 600 logs/gallery.tokens; ./logd > /dev/null 2>&1 & sleep 1");
+    runCommand(
+        "Test 12.6: ENTER emp013 through logd with the kiosk token",
+        "./logclient -T kiosk-001 -E ENTER -P emp013 -R lobby"
+    );
+    std::system("grep admin_lee logs/tokens.txt > logs/tokens2.txt;"
+                " ./logtokens -T lee-admin-789 -i logs/tokens2.txt > /dev/null; sleep 1");
+    runCommand(
+        "Test 12.7: Kiosk token after rotation, logd not restarted (should FAIL)",
+        "./logclient -T kiosk-001 -E EXIT -P emp013 -R -"
+    );
+    runCommand(
+        "Test 12.8: 50 reloads leave one token store mapped in logd",
+        "for i in $(seq 50); do pkill -HUP -x logd; sleep 0.02; done; sleep 1;"
+        " [ \"$(grep -c gallery.tokens /proc/$(pgrep -x logd)/maps)\" -le 1 ]"
+    );
+    runCommand(
+        "Test 12.9: QUERY '*' larger than one reply chunk through logd",
+        "./logclient -T lee-admin-789 -n 3000 > /dev/null &&"
+        " ./logclient -T lee-admin-789 -Q '*' | grep '^Parsed [0-9]\\{4,\\} log entries'"
+    );
+    runCommand(
+        "Test 12.10: QUERY answered while another client stops reading its replies",
+        "./logclient -T lee-admin-789 -n 60000 > /dev/null &&"
+        " { perl -MIO::Socket::UNIX -e '$s = IO::Socket::UNIX->new(Peer => \"logs/gallerylog.sock\") or exit 1;"
+        " print $s \"1 AUTH lee-admin-789\\n\", map({ \"$_ QUERY *\\n\" } 2..5); sleep 20' & } &&"
+        " sleep 2 && timeout 5 ./logclient -T lee-admin-789 -Q emp013"
+    );
+    std::system("pkill -f 'IO::Socket::UNI[X]'");
+    std::system("pkill -TERM -x logd; sleep 1");
+    std::system("rm -f logs/gallery.tokens logs/tokens.txt logs/tokens2.txt");
+
+    // 13) Session tickets
+    runCommand(
+        "Test 13.1: ENTER emp014 with a session ticket",
+        "./logappend -S $(./logsession -T alex-write-123) -E ENTER -P emp014 -R lobby"
+    );
+    runCommand(
+        "Test 13.2: Read with an APPEND-ONLY ticket (should FAIL)",
+        "./logread -S $(./logsession -T alex-write-123)"
+    );
+    runCommand(
+        "Test 13.3: Ticket claiming another actor (should FAIL)",
+        "./logappend -S $(./logsession -T alex-write-123 | sed s/guard_alex/admin_lee/)"
+        " -E EXIT -P emp014 -R -"
+    );
+    runCommand(
+        "Test 13.4: Ticket lifetime over the limit (should FAIL)",
+        "./logsession -T alex-write-123 -t 3600"
+    );
+    runCommand(
+        "Test 13.5: Ticket after the session key was rotated (should FAIL)",
+        "T=$(./logsession -T alex-write-123) && ./logsession -T lee-admin-789 -r &&"
+        " ./logappend -S $T -E EXIT -P emp014 -R -"
+    );
+    std::system("rm -f logs/session.key");
+
+    // 14) Text scanning kernels (every kernel must parse the log the same)
+    runCommand(
+        "Test 14.1: logread with the scalar scanner (same output)",
+        "[ \"$(GALLERYLOG_SCAN=scalar ./logread -T lee-admin-789)\" = \"$(./logread -T lee-admin-789)\" ]"
+    );
+    runCommand(
+        "Test 14.2: logread with the SSE4.2 scanner (same output)",
+        "[ \"$(GALLERYLOG_SCAN=sse4.2 ./logread -T lee-admin-789)\" = \"$(./logread -T lee-admin-789)\" ]"
+    );
+
+    // 15) Sub-second timestamps
+    runCommand(
+        "Test 15.1: ENTER emp015 with microsecond timestamps",
+        "GALLERYLOG_TIME=us ./logappend -T alex-write-123 -E ENTER -P emp015 -R lobby &&"
+        " ./logread -T kim-read-456 | grep -E '^[0-9]+\\.[0-9]{6} \\| guard_alex \\| emp015 \\| ENTER'"
+    );
+    runCommand(
+        "Test 15.2: Line with a 2-digit fraction is skipped (should FAIL)",
+        "printf '1700000000.25|guard_alex|emp016|ENTER|lobby\\n' >> logs/gallery.log &&"
+        " ./logread -T kim-read-456 | grep emp016"
+    );
+    runCommand(
+        "Test 15.3: Microseconds survive text2bin and bin2text",
+        "rm -f logs/t.bin logs/t.txt &&"
+        " ./logconvert -T lee-admin-789 -m text2bin -i logs/gallery.log -o logs/t.bin > /dev/null 2>&1 &&"
+        " ./logconvert -T lee-admin-789 -m bin2text -i logs/t.bin -o logs/t.txt > /dev/null 2>&1 &&"
+        " grep -E '^[0-9]+\\.[0-9]{6}\\|guard_alex\\|emp015\\|ENTER\\|lobby$' logs/t.txt"
+    );
+    runCommand(
+        "Test 15.4: logconvert with -j 0 (should FAIL)",
+        "rm -f logs/t.bin && ./logconvert -T lee-admin-789 -m text2bin -i logs/gallery.log -o logs/t.bin -j 0"
+    );
+    runCommand(
+        "Test 15.5: Checkpoint records survive text2bin and bin2text",
+        "rm -f logs/t.bin logs/t.txt && ./logcompact -T lee-admin-789 > /dev/null &&"
+        " ./logconvert -T lee-admin-789 -m text2bin -i logs/gallery.log -o logs/t.bin > /dev/null &&"
+        " ./logconvert -T lee-admin-789 -m bin2text -i logs/t.bin -o logs/t.txt | grep 'rejected 0' &&"
+        " grep '^#checkpoint|' logs/t.txt && cmp logs/gallery.log logs/t.txt"
+    );
+    std::system("rm -f logs/t.bin logs/t.txt");
+
+    // 16) Shared-memory event ring (logenqueue -> logingest)
+    runCommand(
+        "Test 16.1: Enqueue with no logingest running (should FAIL)",
+        "rm -f /dev/shm/gallerylog-ring && ./logenqueue -T alex-write-123 -E ENTER -P emp020 -R vault"
+    );
+    std::system("./logingest -T alex-write-123 > /dev/null 2>&1 & sleep 1");
+    runCommand(
+        "Test 16.2: Enqueue ENTER emp020 and MOVE emp020",
+        "./logenqueue -T alex-write-123 -E ENTER -P emp020 -R vault &&"
+        " ./logenqueue -T alex-write-123 -E MOVE -P emp020 -R lobby"
+    );
+    runCommand(
+        "Test 16.3: Enqueue with a READ-ONLY token (should FAIL)",
+        "./logenqueue -T kim-read-456 -E ENTER -P emp021 -R vault"
+    );
+    std::system("sleep 1; pkill -TERM -x logingest; sleep 1");
+    runCommand(
+        "Test 16.4: logingest appended both queued events",
+        "./logread -T kim-read-456 | grep -c 'guard_alex | emp020 |' | grep -x 2"
+    );
+    std::system("./logingest -T alex-write-123 > /dev/null 2>&1 & sleep 1");
+    runCommand(
+        "Test 16.5: Event held while the log cannot be written is appended later",
+        "echo broken > logs/gallery.manifest &&"
+        " ./logenqueue -T alex-write-123 -E ENTER -P emp022 -R vault && sleep 1 &&"
+        " rm -f logs/gallery.manifest && sleep 2 && pkill -TERM -x logingest && sleep 1 &&"
+        " ./logread -T kim-read-456 | grep 'guard_alex | emp022 | ENTER'"
+    );
+    std::system("pkill -TERM -x logingest; rm -f logs/gallery.manifest");
+    std::system("{ echo \"kiosk_001 AppendOnly $(printf kiosk-001 | sha256sum | cut -d' ' -f1)\";"
+                " echo \"admin_lee ReadWrite $(printf lee-admin-789 | sha256sum | cut -d' ' -f1)\"; }"
+                " > logs/tokens.txt; grep admin_lee logs/tokens.txt > logs/tokens2.txt;"
+                " ./logtokens -T lee-admin-789 -i logs/tokens.txt > /dev/null;"
+                " ./logingest -T lee-admin-789 > /dev/null 2>&1 & sleep 1");
+    runCommand(
+        "Test 16.6: Event queued before its token was revoked is not appended",
+        "pkill -STOP -x logingest && ./logenqueue -T kiosk-001 -E ENTER -P emp023 -R vault &&"
+        " ./logtokens -T lee-admin-789 -i logs/tokens2.txt > /dev/null && pkill -CONT -x logingest &&"
+        " sleep 1 && pkill -TERM -x logingest && sleep 1 &&"
+        " ! ./logread -T lee-admin-789 | grep emp023"
+    );
+    std::system("pkill -TERM -x logingest; rm -f logs/gallery.tokens logs/tokens.txt logs/tokens2.txt");
+    std::system("./logingest -T alex-write-123 > /dev/null 2>&1 & sleep 1");
+    runCommand(
+        "Test 16.7: Second logingest on the same ring is refused (exit 1)",
+        "timeout 3 ./logingest -T alex-write-123; [ $? -eq 1 ]"
+    );
+    std::system("pkill -TERM -x logingest");
+
+    // 17) ID dictionary write cut short (file size limit), then retried
+    std::system("sleep 1; rm -f logs/gallery.log logs/gallery.ids logs/gallery.*.log logs/gallery.manifest;"
+                " for i in $(seq 1000 2021); do echo pad$i; done > logs/gallery.ids;"
+                " (trap '' XFSZ; ulimit -S -f 16; exec ./logingest -T alex-write-123) > /dev/null 2>&1 & sleep 1");
+    runCommand(
+        "Test 17.1: IDs whose dictionary write failed are written on the retry",
+        "./logenqueue -T alex-write-123 -E ENTER -P emp030abcdefghij -R vault && sleep 1 &&"
+        " prlimit --pid $(pgrep -x logingest) --fsize=unlimited && sleep 3 && pkill -TERM -x logingest && sleep 1 &&"
+        " grep -x emp030abcdefghij logs/gallery.ids && ./logread -T kim-read-456 | grep emp030abcdefghij"
+    );
+    std::system("pkill -KILL -x logingest");
+
     std::cout << "--------------------------------------------------\n";
     std::cout << "Test run complete. Review outputs and exit codes above.\n";
     return 0;
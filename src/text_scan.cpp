@@ -0,0 +1,174 @@
+// text_scan.{h,cpp}
+// -------------------------------------
+// Byte classification kernels and their runtime selection.
+//
+// responsibilities:
+// AVX2, SSE4.2 and scalar kernels producing the same ScanMasks
+// pick the best kernel the CPU supports once (GALLERYLOG_SCAN overrides)
+// partial blocks: copy into a zeroed 64-byte buffer, so kernels always
+// read whole blocks and never past the caller's bytes
+
+#include "text_scan.h"
+#include <algorithm>       // min
+#include <array>
+#include <cstdlib>         // getenv
+#include <cstring>         // memcpy, strcmp
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GALLERYLOG_HAVE_X86_SIMD 1
+#endif
+
+// Classifies `blocks` whole blocks at p into out[0..blocks).
+using BlockKernel = void (*)(const char* p, size_t blocks, ScanMasks* out);
+
+// Scalar: one table lookup per byte.
+enum : uint8_t { C_NEWLINE = 1, C_BAR = 2, C_ID = 4 }; // bit order used below
+
+static constexpr std::array<uint8_t, 256> CLASS_TABLE = [] {
+    std::array<uint8_t, 256> t{};
+    t['\n'] = C_NEWLINE;
+    t['|'] = C_BAR;
+    for (int c = '0'; c <= '9'; ++c) t[c] = C_ID;
+    for (int c = 'A'; c <= 'Z'; ++c) t[c] = t[c + 32] = C_ID;
+    t['_'] = t['-'] = C_ID;
+    return t;
+}();
+
+static void scanBlocksScalar(const char* p, size_t blocks, ScanMasks* out) {
+    for (size_t b = 0; b < blocks; ++b, p += SCAN_BLOCK) {
+        uint64_t newline = 0, bar = 0, idChar = 0;
+        for (size_t i = 0; i < SCAN_BLOCK; ++i) {
+            const uint64_t c = CLASS_TABLE[static_cast<uint8_t>(p[i])];
+            newline |= (c & 1) << i;
+            bar |= (c >> 1 & 1) << i;
+            idChar |= (c >> 2 & 1) << i;
+        }
+        out[b] = ScanMasks{newline, bar, idChar};
+    }
+}
+
+#ifdef GALLERYLOG_HAVE_X86_SIMD
+
+// SSE4.2: pcmpestrm matches each byte against a list of ranges in one go.
+__attribute__((target("sse4.2")))
+static void scanBlocksSse42(const char* p, size_t blocks, ScanMasks* out) {
+    alignas(16) static const char ID_RANGES[16] = "AZaz09__--";
+    const __m128i idRanges = _mm_load_si128(reinterpret_cast<const __m128i*>(ID_RANGES));
+    const __m128i newline = _mm_set1_epi8('\n'), bar = _mm_set1_epi8('|');
+    constexpr int RANGES = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK;
+
+    for (size_t b = 0; b < blocks; ++b, p += SCAN_BLOCK) {
+        ScanMasks m;
+        for (int i = 0; i < 4; ++i) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            const int shift = 16 * i;
+            m.newline |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)))) << shift;
+            m.bar |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, bar)))) << shift;
+            m.idChar |= uint64_t(uint32_t(_mm_cvtsi128_si32(_mm_cmpestrm(idRanges, 10, v, 16, RANGES)))) << shift;
+        }
+        out[b] = m;
+    }
+}
+
+// lo <= v <= hi per unsigned byte, as all-ones lanes.
+__attribute__((target("avx2")))
+static inline __m256i inRange(__m256i v, __m256i lo, __m256i hi) {
+    return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, lo), v),
+                            _mm256_cmpeq_epi8(_mm256_min_epu8(v, hi), v));
+}
+
+// The class masks of 32 bytes, as all-ones lanes.
+struct Avx2Classes {
+    __m256i newline, bar, idChar;
+};
+
+// Letters are folded to lower case with | 0x20, which maps no other byte
+// into a-z.
+__attribute__((target("avx2")))
+static inline Avx2Classes classifyAvx2(__m256i v) {
+    const __m256i digit = inRange(v, _mm256_set1_epi8('0'), _mm256_set1_epi8('9'));
+    const __m256i alpha = inRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'),
+                                  _mm256_set1_epi8('z'));
+    const __m256i punct = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')),
+                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+    return {_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')),
+            _mm256_or_si256(_mm256_or_si256(digit, alpha), punct)};
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t movemask64(__m256i lo, __m256i hi) {
+    return uint32_t(_mm256_movemask_epi8(lo)) | uint64_t(uint32_t(_mm256_movemask_epi8(hi))) << 32;
+}
+
+// AVX2: two 32-byte halves per block.
+__attribute__((target("avx2")))
+static void scanBlocksAvx2(const char* p, size_t blocks, ScanMasks* out) {
+    for (size_t b = 0; b < blocks; ++b, p += SCAN_BLOCK) {
+        const Avx2Classes lo = classifyAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+        const Avx2Classes hi = classifyAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)));
+        out[b] = ScanMasks{movemask64(lo.newline, hi.newline), movemask64(lo.bar, hi.bar),
+                           movemask64(lo.idChar, hi.idChar)};
+    }
+}
+
+#endif // GALLERYLOG_HAVE_X86_SIMD
+
+ScanBackend scanBackend() {
+    static const ScanBackend backend = [] {
+        ScanBackend best = ScanBackend::Scalar;
+#ifdef GALLERYLOG_HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")) best = ScanBackend::Sse42;
+        if (__builtin_cpu_supports("avx2")) best = ScanBackend::Avx2;
+#endif
+        const char* env = std::getenv("GALLERYLOG_SCAN");
+        if (env && std::strcmp(env, "scalar") == 0) return ScanBackend::Scalar;
+        if (env && std::strcmp(env, "sse4.2") == 0 && best == ScanBackend::Avx2) return ScanBackend::Sse42;
+        return best;
+    }();
+    return backend;
+}
+
+const char* scanBackendName(ScanBackend b) {
+    switch (b) {
+        case ScanBackend::Avx2:  return "avx2";
+        case ScanBackend::Sse42: return "sse4.2";
+        default:                 return "scalar";
+    }
+}
+
+static BlockKernel blockKernel() {
+    static const BlockKernel k = [] {
+        switch (scanBackend()) {
+#ifdef GALLERYLOG_HAVE_X86_SIMD
+            case ScanBackend::Avx2:  return scanBlocksAvx2;
+            case ScanBackend::Sse42: return scanBlocksSse42;
+#endif
+            default:                 return scanBlocksScalar;
+        }
+    }();
+    return k;
+}
+
+void scanBlocks(const char* p, size_t n, ScanMasks* out) {
+    const size_t full = n / SCAN_BLOCK, rest = n % SCAN_BLOCK;
+    blockKernel()(p, full, out);
+    if (rest) {
+        // NUL is in no class, so the padding leaves every mask bit past n clear.
+        char buf[SCAN_BLOCK] = {};
+        std::memcpy(buf, p + full * SCAN_BLOCK, rest);
+        blockKernel()(buf, 1, out + full);
+    }
+}
+
+void scanLine(std::string_view line, LineMasks& m) {
+    m.part[1] = ScanMasks{};
+    scanBlocks(line.data(), std::min(line.size(), MAX_SCANNED_LINE), m.part);
+}
+
+bool allIdChars(std::string_view s) {
+    if (s.size() > SCAN_BLOCK) return false;
+    ScanMasks m;
+    scanBlocks(s.data(), s.size(), &m);
+    return m.idChar == lowBits(s.size());
+}
@@ -0,0 +1,120 @@
+// text_scan.{h,cpp}
+// -------------------------------------
+// Vectorised byte classification for the text log parser.
+//
+// The parser looks at every byte of a log for the same few things: line
+// ends, field separators, and whether a field is made of ID characters
+// ([A-Za-z0-9_-]). scanBlocks() answers all of them for each 64-byte
+// block at once, as one bit per byte in each of three masks, so
+// the parser finds fields with tzcnt and validates them by comparing a
+// field's bit range against a mask instead of looping over its bytes.
+//
+// The kernel is chosen once per process: AVX2 (two 32-byte halves per
+// block), SSE4.2 (four 16-byte quarters, character ranges with
+// pcmpestrm), or a table-driven scalar loop. GALLERYLOG_SCAN=scalar|sse4.2 picks a
+// lesser kernel, e.g. to compare results or timings.
+
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+inline constexpr size_t SCAN_BLOCK = 64;
+
+// Bit i describes byte i of the block; bits past the scanned length are 0.
+struct ScanMasks {
+    uint64_t newline = 0; // '\n'
+    uint64_t bar = 0;     // '|'
+    uint64_t idChar = 0;  // A-Z a-z 0-9 _ -
+};
+
+enum class ScanBackend { Scalar, Sse42, Avx2 };
+
+ScanBackend scanBackend();
+const char* scanBackendName(ScanBackend b);
+
+// Classifies the n bytes at p into out[0 .. ceil(n / SCAN_BLOCK)); a
+// short last block is zero-padded. Reads only those n bytes.
+void scanBlocks(const char* p, size_t n, ScanMasks* out);
+
+// The low n bits set (n <= 64).
+constexpr uint64_t lowBits(size_t n) {
+    return n >= 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+}
+
+// Whole-string check for short strings (IDs); strings longer than one
+// block are rejected, which the ID length limit is below.
+bool allIdChars(std::string_view s);
+
+// Masks for the first MAX_SCANNED_LINE bytes of one line, bit 0 being the
+// line's first byte; bits past the line's end are 0.
+inline constexpr size_t MAX_SCANNED_LINE = 2 * SCAN_BLOCK;
+
+struct LineMasks {
+    ScanMasks part[2]; // bytes 0..63, 64..127
+};
+
+// Classifies line, up to its first MAX_SCANNED_LINE bytes.
+void scanLine(std::string_view line, LineMasks& m);
+
+// Shifts block masks so bit 0 is byte `offset` of lo, continuing into hi,
+// and keeps the low `len` bits.
+inline void windowMasks(const ScanMasks& lo, const ScanMasks& hi, size_t offset, size_t len,
+                        ScanMasks& out) {
+    const uint64_t keep = lowBits(len);
+    auto shift = [&](uint64_t a, uint64_t b) {
+        return (offset ? a >> offset | b << (SCAN_BLOCK - offset) : a) & keep;
+    };
+    out.newline = shift(lo.newline, hi.newline);
+    out.bar = shift(lo.bar, hi.bar);
+    out.idChar = shift(lo.idChar, hi.idChar);
+}
+
+// Calls fn(line, masks) for every '\n'-terminated line in [p, p + n),
+// without its '\n'. The buffer is classified once, SCAN_BATCH blocks per
+// kernel call, and each line gets its masks cut out of the blocks it
+// spans; a line longer than MAX_SCANNED_LINE is rescanned on its own (its
+// first blocks have left the window by then). Returns the bytes consumed:
+// up to and including the last '\n'.
+inline constexpr size_t SCAN_BATCH = 16;
+
+template <typename Fn>
+size_t forEachScannedLine(const char* p, size_t n, Fn&& fn) {
+    // [0, 2): the last two blocks of the previous batch, [2, 2 + SCAN_BATCH):
+    // this batch, then two spare slots a window may reach past the end of
+    // the data (their bits lie past the line's end and get cleared)
+    ScanMasks win[SCAN_BATCH + 4];
+    LineMasks masks;
+    size_t lineStart = 0;
+    for (size_t base = 0; base < n; base += SCAN_BATCH * SCAN_BLOCK) {
+        const size_t len = n - base < SCAN_BATCH * SCAN_BLOCK ? n - base : SCAN_BATCH * SCAN_BLOCK;
+        const size_t blocks = (len + SCAN_BLOCK - 1) / SCAN_BLOCK;
+        scanBlocks(p + base, len, win + 2);
+
+        for (size_t i = 0; i < blocks; ++i) {
+            for (uint64_t nl = win[2 + i].newline; nl; nl &= nl - 1) {
+                const size_t end = base + i * SCAN_BLOCK + static_cast<size_t>(__builtin_ctzll(nl));
+                const std::string_view line(p + lineStart, end - lineStart);
+                if (line.size() <= MAX_SCANNED_LINE) {
+                    // starts at most two blocks before the one holding its end
+                    const size_t first = lineStart / SCAN_BLOCK + 2 - base / SCAN_BLOCK;
+                    const size_t offset = lineStart % SCAN_BLOCK;
+                    const size_t len0 = line.size() < SCAN_BLOCK ? line.size() : SCAN_BLOCK;
+                    windowMasks(win[first], win[first + 1], offset, len0, masks.part[0]);
+                    windowMasks(win[first + 1], win[first + 2], offset, line.size() - len0, masks.part[1]);
+                } else {
+                    scanLine(line, masks);
+                }
+                fn(line, masks);
+                lineStart = end + 1;
+            }
+        }
+        win[0] = win[blocks];
+        win[1] = win[blocks + 1];
+    }
+    return lineStart;
+}
+
+#endif // TEXT_SCAN_H
@@ -0,0 +1,234 @@
+// thread_pool.{h,cpp}
+// -------------------------------------
+// Work-stealing scheduler shared by all parallel paths.
+//
+// responsibilities:
+// size the pool once: -j, GALLERYLOG_JOBS or the CPU count
+// one mutex-guarded deque per worker: owner works LIFO at the back,
+// thieves steal FIFO from the front
+// park idle workers on a condition variable (no spinning)
+// let waiting callers run queued tasks instead of blocking
+// recursive range splitting for parallelFor
+
+#include "thread_pool.h"
+#include <algorithm>       // std::min, std::max
+#include <charconv>        // from_chars
+#include <chrono>
+#include <cstdlib>         // getenv
+#include <cstring>         // strlen
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+static constexpr unsigned MAX_JOBS = MAX_THREAD_POOL_JOBS;
+
+bool parseJobs(const char* s, unsigned& jobs) {
+    const char* end = s + std::strlen(s);
+    unsigned v = 0;
+    auto [ptr, ec] = std::from_chars(s, end, v);
+    if (ec != std::errc() || ptr != end || v < 1 || v > MAX_JOBS) return false;
+    jobs = v;
+    return true;
+}
+
+static unsigned& requestedJobs() {
+    static unsigned jobs = 0; // 0 = not set by the tool
+    return jobs;
+}
+
+static unsigned loadJobs() {
+    unsigned jobs = requestedJobs();
+    if (jobs == 0) {
+        const char* env = std::getenv("GALLERYLOG_JOBS");
+        if (env && !parseJobs(env, jobs)) jobs = 0; // ignored if malformed
+    }
+    if (jobs == 0) jobs = std::thread::hardware_concurrency();
+    return std::min(std::max(jobs, 1u), MAX_JOBS);
+}
+
+struct Job {
+    std::function<void()> fn;
+    TaskGroup* group = nullptr;
+};
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned jobs);
+    ~ThreadPool();
+
+    unsigned jobs() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    void push(Job job);
+    bool take(Job& out); // own deque first, then steal
+    static void execute(Job& job);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::thread thread;
+    };
+
+    void workerLoop(size_t self);
+    bool popBack(size_t w, Job& out);
+    bool popFront(size_t w, Job& out);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> queued_{0};      // jobs sitting in any deque
+    std::atomic<size_t> nextVictim_{0};  // round robin for outside pushes/steals
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+// Index of the calling worker in its pool, or -1 for other threads.
+static thread_local long tlsWorker = -1;
+
+ThreadPool::ThreadPool(unsigned jobs) {
+    for (unsigned i = 1; i < jobs; ++i) workers_.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->thread = std::thread([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(sleepMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& w : workers_) w->thread.join();
+}
+
+void ThreadPool::push(Job job) {
+    const size_t w = tlsWorker >= 0 ? static_cast<size_t>(tlsWorker)
+                                    : nextVictim_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+        std::lock_guard<std::mutex> lk(workers_[w]->mutex);
+        workers_[w]->jobs.push_back(std::move(job));
+    }
+    {
+        // counted under sleepMutex_ so a worker about to sleep sees it
+        std::lock_guard<std::mutex> lk(sleepMutex_);
+        queued_.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::popBack(size_t w, Job& out) {
+    std::lock_guard<std::mutex> lk(workers_[w]->mutex);
+    if (workers_[w]->jobs.empty()) return false;
+    out = std::move(workers_[w]->jobs.back());
+    workers_[w]->jobs.pop_back();
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool ThreadPool::popFront(size_t w, Job& out) {
+    std::lock_guard<std::mutex> lk(workers_[w]->mutex);
+    if (workers_[w]->jobs.empty()) return false;
+    out = std::move(workers_[w]->jobs.front());
+    workers_[w]->jobs.pop_front();
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool ThreadPool::take(Job& out) {
+    if (queued_.load(std::memory_order_relaxed) == 0) return false;
+    if (tlsWorker >= 0 && popBack(static_cast<size_t>(tlsWorker), out)) return true;
+
+    const size_t n = workers_.size();
+    const size_t first = nextVictim_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < n; ++i) {
+        const size_t victim = (first + i) % n;
+        if (static_cast<long>(victim) != tlsWorker && popFront(victim, out)) return true;
+    }
+    return false;
+}
+
+void ThreadPool::execute(Job& job) {
+    job.fn();
+    job.fn = nullptr; // drop captures before the group can be destroyed
+    job.group->finishOne();
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    tlsWorker = static_cast<long>(self);
+    while (true) {
+        Job job;
+        if (take(job)) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(sleepMutex_);
+        wake_.wait(lk, [&] { return stopping_ || queued_.load(std::memory_order_relaxed) > 0; });
+        if (stopping_) return;
+    }
+}
+
+static ThreadPool& sharedPool() {
+    static ThreadPool pool(loadJobs());
+    return pool;
+}
+
+void setThreadPoolJobs(unsigned jobs) { requestedJobs() = std::min(jobs, MAX_JOBS); }
+unsigned threadPoolJobs() { return sharedPool().jobs(); }
+
+void TaskGroup::run(std::function<void()> fn) {
+    ThreadPool& pool = sharedPool();
+    if (pool.jobs() == 1) {
+        fn();
+        return;
+    }
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    pool.push(Job{std::move(fn), this});
+}
+
+void TaskGroup::finishOne() {
+    // Under the mutex: wait() cannot return (and destroy the group)
+    // between the decrement and the notify.
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) done_.notify_all();
+}
+
+void TaskGroup::wait() {
+    while (pending_.load(std::memory_order_acquire) != 0) {
+        Job job;
+        if (sharedPool().take(job)) {
+            ThreadPool::execute(job);
+            continue;
+        }
+        // The rest is running elsewhere; it may still queue subtasks, so
+        // look for work again now and then.
+        std::unique_lock<std::mutex> lk(mutex_);
+        done_.wait_for(lk, std::chrono::milliseconds(1),
+                       [&] { return pending_.load(std::memory_order_acquire) == 0; });
+    }
+    std::lock_guard<std::mutex> lk(mutex_); // last finishOne() has let go
+}
+
+static void splitRange(TaskGroup& group, size_t begin, size_t end, size_t grain,
+                       const std::function<void(size_t, size_t)>& fn) {
+    // Queue the upper half, keep the lower half: thieves get big pieces.
+    while (end - begin > grain) {
+        const size_t mid = begin + (end - begin) / 2;
+        group.run([&group, mid, end, grain, &fn] { splitRange(group, mid, end, grain, fn); });
+        end = mid;
+    }
+    if (begin < end) fn(begin, end);
+}
+
+void parallelFor(size_t begin, size_t end, size_t grain,
+                 const std::function<void(size_t, size_t)>& fn) {
+    if (grain == 0) grain = 1;
+    if (end <= begin) return;
+
+    if (end - begin <= grain || threadPoolJobs() == 1) {
+        for (size_t b = begin; b < end; b += std::min(grain, end - b)) fn(b, std::min(end, b + grain));
+        return;
+    }
+    TaskGroup group;
+    splitRange(group, begin, end, grain, fn);
+    group.wait();
+}
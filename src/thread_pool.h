@@ -0,0 +1,71 @@
+// thread_pool.{h,cpp}
+// -------------------------------------
+// Process-wide work-stealing scheduler shared by every parallel scan,
+// parse and conversion path, so several of them running at once share
+// one set of threads instead of each starting its own.
+//
+//   TaskGroup g;
+//   for (auto& shard : shards) g.run([&] { scan(shard); });
+//   g.wait();
+//
+//   parallelFor(0, chunks, 1, [&](size_t b, size_t e) { ... });
+//
+// Every worker owns a deque: it pushes and pops its own tasks at the back
+// (newest first, cache warm) and idle workers steal from the front of
+// the others (oldest, i.e. biggest, first). parallelFor splits its range
+// in halves and queues one half, so thieves take large pieces and split
+// them further. A thread blocked in wait() runs queued tasks meanwhile,
+// so nested parallel calls never deadlock and never add threads.
+//
+// Concurrency is fixed on first use: setThreadPoolJobs() (the tools' -j),
+// else GALLERYLOG_JOBS, else the number of CPUs. N jobs = N-1 workers
+// plus the waiting caller; 1 job runs everything inline.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+// Call before the first parallel operation; later calls are ignored.
+void setThreadPoolJobs(unsigned jobs);
+unsigned threadPoolJobs();
+
+inline constexpr unsigned MAX_THREAD_POOL_JOBS = 256;
+
+// Parses a -j (or GALLERYLOG_JOBS) value: decimal digits only, 1..256.
+bool parseJobs(const char* s, unsigned& jobs);
+
+// Set of tasks that can be waited for together.
+class TaskGroup {
+public:
+    TaskGroup() = default;
+    ~TaskGroup() { wait(); }
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Queue fn on the pool (runs inline with 1 job).
+    void run(std::function<void()> fn);
+
+    // Returns once every task run() so far, including tasks those tasks
+    // added to this group, has finished. Helps with queued work meanwhile.
+    void wait();
+
+private:
+    friend class ThreadPool;
+    void finishOne();
+
+    std::atomic<size_t> pending_{0};
+    std::mutex mutex_;
+    std::condition_variable done_;
+};
+
+// Calls fn(b, e) on disjoint subranges of [begin, end), each at most
+// grain long, in parallel; returns when all are done.
+void parallelFor(size_t begin, size_t end, size_t grain,
+                 const std::function<void(size_t, size_t)>& fn);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,368 @@
+// token_store.{h,cpp}
+// -------------------------------------
+// Hash-indexed, file-backed token store.
+//
+// responsibilities:
+// build the open-addressed table (buckets of 4 records, load <= 50%)
+// mmap a store file after checking owner, type and permissions
+// validate the header and table geometry before any lookup
+// constant-time lookup: fixed probe count, every record compared in full,
+// the match selected with masks instead of branches
+// pick the store for this process: file, else built-in
+// publish reloaded stores with an atomic pointer swap (RCU style), pin
+// generations with reader counts and free replaced ones once unpinned
+// inotify watch on the store file for resident processes
+
+#include "token_store.h"
+#include <algorithm>       // std::max
+#include <cerrno>
+#include <climits>         // NAME_MAX
+#include <cstdlib>         // getenv
+#include <cstring>         // memcpy, memcmp
+#include <mutex>
+#include <fcntl.h>         // open flags
+#include <sys/inotify.h>   // TokenStoreWatch
+#include <sys/mman.h>      // mmap
+#include <sys/stat.h>      // fstat
+#include <unistd.h>        // close, geteuid
+
+// Home bucket: the digest is uniform, so its first 8 bytes are a hash.
+static uint32_t homeBucket(const Digest& digest, uint32_t bucketCount) {
+    uint64_t h;
+    std::memcpy(&h, digest.data(), sizeof(h));
+    return static_cast<uint32_t>(h & (bucketCount - 1));
+}
+
+bool buildTokenTable(const std::vector<UserTokenInfo>& users, std::vector<uint8_t>& out,
+                     std::string& error) {
+    uint32_t buckets = 1;
+    while (static_cast<size_t>(buckets) * TOKEN_BUCKET_SLOTS < 2 * users.size()) buckets <<= 1;
+
+    out.assign(sizeof(TokenStoreHeader) + static_cast<size_t>(buckets) * TOKEN_BUCKET_SLOTS * sizeof(TokenRecord), 0);
+    TokenStoreHeader h{};
+    std::memcpy(h.magic, TOKEN_STORE_MAGIC, sizeof(h.magic));
+    h.version = TOKEN_STORE_VERSION;
+    h.recordSize = sizeof(TokenRecord);
+    h.bucketCount = buckets;
+    h.slotsPerBucket = TOKEN_BUCKET_SLOTS;
+    h.probeLimit = 1;
+    h.tokenCount = static_cast<uint32_t>(users.size());
+
+    TokenRecord* records = reinterpret_cast<TokenRecord*>(out.data() + sizeof(TokenStoreHeader));
+    for (const auto& user : users) {
+        TokenRecord rec{};
+        if (!validatePersonId(user.actorId)) {
+            error = "invalid actor ID";
+            return false;
+        }
+        rec.digest = user.tokenHash;
+        rec.used = 1;
+        rec.permission = static_cast<uint8_t>(user.permission);
+        rec.actorLen = static_cast<uint8_t>(user.actorId.size());
+        std::memcpy(rec.actorId, user.actorId.data(), user.actorId.size());
+
+        // Slots are never freed, so a duplicate sits before the first free
+        // slot on the probe path.
+        const uint32_t home = homeBucket(rec.digest, buckets);
+        bool placed = false;
+        for (uint32_t d = 0; d < buckets && !placed; ++d) {
+            TokenRecord* bucket = records + static_cast<size_t>((home + d) & (buckets - 1)) * TOKEN_BUCKET_SLOTS;
+            for (uint32_t s = 0; s < TOKEN_BUCKET_SLOTS; ++s) {
+                if (bucket[s].used && bucket[s].digest == rec.digest) {
+                    error = "duplicate token for " + user.actorId.str();
+                    return false;
+                }
+                if (!bucket[s].used) {
+                    bucket[s] = rec;
+                    h.probeLimit = std::max(h.probeLimit, d + 1);
+                    placed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::memcpy(out.data(), &h, sizeof(h));
+    return true;
+}
+
+TokenStore::~TokenStore() {
+    if (matched_) {
+        const size_t slots = static_cast<size_t>(header_->bucketCount) * TOKEN_BUCKET_SLOTS;
+        for (size_t i = 0; i < slots; ++i) delete matched_[i].load(std::memory_order_relaxed);
+    }
+    if (map_) ::munmap(map_, mapLen_);
+}
+
+bool TokenStore::attach(const uint8_t* data, size_t len, std::string& error) {
+    if (len < sizeof(TokenStoreHeader)) {
+        error = "token store is truncated";
+        return false;
+    }
+    const auto* h = reinterpret_cast<const TokenStoreHeader*>(data);
+    const size_t slots = static_cast<size_t>(h->bucketCount) * TOKEN_BUCKET_SLOTS;
+    if (std::memcmp(h->magic, TOKEN_STORE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != TOKEN_STORE_VERSION || h->recordSize != sizeof(TokenRecord) ||
+        h->slotsPerBucket != TOKEN_BUCKET_SLOTS || h->bucketCount == 0 ||
+        (h->bucketCount & (h->bucketCount - 1)) != 0 ||
+        h->probeLimit == 0 || h->probeLimit > h->bucketCount || h->tokenCount > slots ||
+        len != sizeof(TokenStoreHeader) + slots * sizeof(TokenRecord)) {
+        error = "token store is malformed";
+        return false;
+    }
+    header_ = h;
+    records_ = reinterpret_cast<const TokenRecord*>(data + sizeof(TokenStoreHeader));
+    matched_.reset(static_cast<std::atomic<const UserTokenInfo*>*>(
+        std::calloc(slots, sizeof(std::atomic<const UserTokenInfo*>))));
+    if (!matched_) {
+        error = "out of memory for token store";
+        return false;
+    }
+    return true;
+}
+
+bool TokenStore::load(const std::string& path, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        error = "cannot open token store";
+        return false;
+    }
+
+    // Anyone who can write the store can mint tokens, and anyone who can
+    // read it can brute-force the digests offline.
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != ::geteuid() ||
+        (st.st_mode & 077) != 0) {
+        error = "token store must be a regular file owned by us with mode 0600";
+        ::close(fd);
+        return false;
+    }
+
+    const size_t len = static_cast<size_t>(st.st_size);
+    void* map = len ? ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        error = "token store is truncated";
+        return false;
+    }
+    map_ = map;
+    mapLen_ = len;
+    return attach(static_cast<const uint8_t*>(map), len, error);
+}
+
+bool TokenStore::build(const std::vector<UserTokenInfo>& users, std::string& error) {
+    if (!buildTokenTable(users, owned_, error)) return false;
+    return attach(owned_.data(), owned_.size(), error);
+}
+
+const UserTokenInfo* TokenStore::find(const std::string& token) const {
+    return find(sha256Digest(token));
+}
+
+const UserTokenInfo* TokenStore::find(const Digest& digest) const {
+    if (!header_) return nullptr;
+
+    // Same records read and compared on every call; no early exit.
+    const uint32_t buckets = header_->bucketCount;
+    const uint32_t home = homeBucket(digest, buckets);
+    size_t match = 0;
+    uint64_t found = 0;
+    for (uint32_t d = 0; d < header_->probeLimit; ++d) {
+        const size_t first = static_cast<size_t>((home + d) & (buckets - 1)) * TOKEN_BUCKET_SLOTS;
+        for (size_t i = first; i < first + TOKEN_BUCKET_SLOTS; ++i) {
+            const TokenRecord& rec = records_[i];
+            const uint64_t diff = digestDiff(rec.digest, digest);
+            const uint64_t eq = (((diff | (0 - diff)) >> 63) ^ 1) & (rec.used & 1u); // 1 iff equal and used
+            const size_t mask = 0 - static_cast<size_t>(eq);
+            match = (match & ~mask) | (i & mask);
+            found |= eq;
+        }
+    }
+    if (!found) return nullptr;
+
+    const UserTokenInfo* cached = matched_[match].load(std::memory_order_acquire);
+    if (cached) return cached;
+
+    // The file is only trusted as far as its permissions go: check the
+    // record before handing it out.
+    const TokenRecord& rec = records_[match];
+    if (rec.permission > static_cast<uint8_t>(Permission::ReadWrite) || rec.actorLen > TOKEN_ID_CAPACITY) {
+        return nullptr;
+    }
+    const GalleryId actorId(std::string_view(rec.actorId, rec.actorLen));
+    if (!validatePersonId(actorId)) return nullptr;
+
+    auto* info = new UserTokenInfo{actorId, static_cast<Permission>(rec.permission), rec.digest};
+    if (!matched_[match].compare_exchange_strong(cached, info, std::memory_order_acq_rel)) {
+        delete info; // another thread materialized it first
+        return cached;
+    }
+    return info;
+}
+
+std::string tokenStorePath() {
+    const char* env = std::getenv("GALLERYLOG_TOKENS");
+    return (env && *env) ? env : TOKEN_STORE_PATH;
+}
+
+// One published store plus the count of pins on it. The block outlives
+// its store: a reader may bump the count of a generation that was just
+// replaced, see that it is no longer current and back off, so the count
+// must stay valid after the store is freed. Blocks whose store was freed
+// are reused for later generations (the count is never reset, so stray
+// increments and their decrements still balance).
+struct TokenStoreRef::Generation {
+    std::unique_ptr<TokenStore> store; // nullptr once freed
+    std::atomic<long> readers{0};
+};
+
+namespace {
+using Generation = TokenStoreRef::Generation;
+
+// Only reloads and the last unpin of a replaced generation take the mutex.
+struct StoreGenerations {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Generation>> blocks;
+    std::atomic<Generation*> current{nullptr};
+};
+}
+
+// Never destroyed either: tearing down at exit would only touch pages.
+static StoreGenerations& generations() {
+    static StoreGenerations* g = new StoreGenerations();
+    return *g;
+}
+
+// Loads what a fresh process would use. ok is false if the file exists
+// but cannot be used; the returned store then denies everyone.
+static std::unique_ptr<TokenStore> loadStore(bool& ok, std::string& error) {
+    auto store = std::make_unique<TokenStore>();
+    const std::string path = tokenStorePath();
+
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0 && errno == ENOENT) {
+        ok = store->build(getBuiltInTokenStore(), error);
+    } else {
+        ok = store->load(path, error);
+    }
+    if (!ok) store = std::make_unique<TokenStore>();
+    return store;
+}
+
+// Frees every replaced generation nobody pins any more. Mutex held.
+static void reclaim(StoreGenerations& g) {
+    const Generation* current = g.current.load();
+    for (auto& gen : g.blocks) {
+        if (gen.get() != current && gen->store && gen->readers.load() == 0) gen->store.reset();
+    }
+}
+
+// Mutex held.
+static void publish(StoreGenerations& g, std::unique_ptr<TokenStore> store) {
+    Generation* gen = nullptr;
+    for (auto& b : g.blocks) {
+        if (!b->store) {
+            gen = b.get();
+            break;
+        }
+    }
+    if (!gen) gen = g.blocks.emplace_back(std::make_unique<Generation>()).get();
+    gen->store = std::move(store);
+    g.current.store(gen);
+    reclaim(g);
+}
+
+// Pin and publish are sequentially consistent: a pin that still sees its
+// generation as current after the increment happened before the reload
+// replaced it, so the reloader sees the count and keeps the store.
+TokenStoreRef getTokenStore() {
+    StoreGenerations& g = generations();
+    while (true) {
+        Generation* gen = g.current.load();
+        if (!gen) {
+            std::lock_guard<std::mutex> lk(g.mutex);
+            if (!g.current.load()) {
+                bool ok;
+                std::string error;
+                auto first = loadStore(ok, error);
+                if (!ok) printSecureError(error); // deny everyone rather than fall back
+                publish(g, std::move(first));
+            }
+            continue;
+        }
+        gen->readers.fetch_add(1);
+        if (g.current.load() == gen) return TokenStoreRef(gen);
+        TokenStoreRef undo(gen); // replaced meanwhile: unpin and retry
+    }
+}
+
+TokenStoreRef::~TokenStoreRef() {
+    if (!gen_ || gen_->readers.fetch_sub(1) != 1) return;
+
+    // Last pin of a replaced generation: free it now rather than at the
+    // next reload.
+    StoreGenerations& g = generations();
+    if (g.current.load() == gen_) return;
+    std::lock_guard<std::mutex> lk(g.mutex);
+    reclaim(g);
+}
+
+const TokenStore& TokenStoreRef::operator*() const { return *gen_->store; }
+
+bool reloadTokenStore(std::string& error) {
+    getTokenStore(); // a first load must not count as a reload
+    StoreGenerations& g = generations();
+    std::lock_guard<std::mutex> lk(g.mutex);
+
+    bool ok;
+    auto next = loadStore(ok, error);
+    if (!ok) return false; // keep serving the current generation
+    publish(g, std::move(next));
+    return true;
+}
+
+TokenStoreWatch::~TokenStoreWatch() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool TokenStoreWatch::start() {
+    // logtokens renames a new file over the store, so watch the directory
+    // (a watch on the file itself would follow the replaced inode).
+    const std::string path = tokenStorePath();
+    const size_t slash = path.rfind('/');
+    const std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    name_ = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) return false;
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB;
+    return ::inotify_add_watch(fd_, dir.c_str(), mask) >= 0;
+}
+
+bool TokenStoreWatch::changed() {
+    alignas(inotify_event) char buf[64 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    bool hit = false;
+    while (true) {
+        ssize_t n = ::read(fd_, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return hit; // EAGAIN: drained
+        }
+        for (ssize_t off = 0; off < n;) {
+            const auto* ev = reinterpret_cast<const inotify_event*>(buf + off);
+            if (ev->mask & IN_Q_OVERFLOW) hit = true; // events lost: assume the worst
+            if (ev->len && name_ == ev->name) hit = true;
+            off += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+        }
+    }
+}
+
+const UserTokenInfo* authenticateToken(const std::string& providedToken,
+                                       Operation requiredOp,
+                                       const TokenStore& store) {
+    if (providedToken.empty()) return nullptr; // Empty tokens are automatically invalid
+
+    const UserTokenInfo* user = store.find(providedToken);
+    if (!user || !permissionAllows(user->permission, requiredOp)) return nullptr;
+    return user;
+}
@@ -0,0 +1,175 @@
+// token_store.{h,cpp}
+// -------------------------------------
+// Token store that scales to any number of issued tokens.
+//
+// file layout (logs/gallery.tokens, or $GALLERYLOG_TOKENS; built by
+// logtokens): one 64-byte header followed by bucketCount buckets of
+// TOKEN_BUCKET_SLOTS 72-byte records, an open-addressed hash table keyed
+// by the SHA-256 digest of the token. Plaintext tokens are never stored.
+//
+// A lookup hashes the token once, then always reads the same number of
+// records (probeLimit buckets from the digest's home bucket) and compares
+// every one of them in constant time, remembering a match without
+// branching. Time therefore depends neither on the token's contents, nor
+// on where (or whether) it is stored, nor on how many tokens exist.
+//
+// The file is mmap'd and only accepted if it is a regular file owned by
+// us with no group/other permissions. Without a file the built-in store
+// (security_utils.cpp) is used, through the same table code.
+//
+// Resident processes can swap the store at runtime (RCU style): a reload
+// builds a complete new TokenStore and publishes it with one atomic
+// pointer store. getTokenStore() pins the current generation with an
+// atomic increment of its reader count, so an authentication never waits
+// for a reload and never takes a lock; calls already running finish on
+// the generation they pinned. A replaced generation is freed (mapping,
+// table and materialized records) as soon as its last pin is released;
+// only its small reader-count block is kept, so a pin taken while the
+// generation was being retired can still be undone safely.
+
+#ifndef TOKEN_STORE_H
+#define TOKEN_STORE_H
+
+#include "security_utils.h"
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+inline const std::string TOKEN_STORE_PATH = "logs/gallery.tokens";
+
+inline constexpr char     TOKEN_STORE_MAGIC[8]  = {'G','L','O','G','T','O','K','1'};
+inline constexpr uint32_t TOKEN_STORE_VERSION   = 1;
+inline constexpr uint32_t TOKEN_BUCKET_SLOTS    = 4;
+inline constexpr size_t   TOKEN_ID_CAPACITY     = 32; // matches the ID length limit
+
+struct TokenStoreHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t bucketCount;   // power of two
+    uint32_t slotsPerBucket;
+    uint32_t probeLimit;    // buckets read by every lookup
+    uint32_t tokenCount;
+    uint8_t  reserved[32];
+};
+
+struct TokenRecord {
+    Digest  digest;                     // SHA-256 of the token
+    uint8_t used;                       // 1 = record present
+    uint8_t permission;                 // Permission code
+    uint8_t actorLen;                   // bytes used in actorId
+    char    actorId[TOKEN_ID_CAPACITY];
+    uint8_t reserved[5];
+};
+
+static_assert(sizeof(TokenStoreHeader) == 64, "token store header layout changed");
+static_assert(sizeof(TokenRecord) == 72, "token record layout changed");
+
+class TokenStore {
+public:
+    TokenStore() = default;
+    ~TokenStore();
+    TokenStore(const TokenStore&) = delete;
+    TokenStore& operator=(const TokenStore&) = delete;
+
+    // mmap and check a store file. Returns false with error set if the
+    // file is missing, has unsafe permissions or is malformed.
+    bool load(const std::string& path, std::string& error);
+
+    // Build the table in memory from a list of users (built-in store).
+    bool build(const std::vector<UserTokenInfo>& users, std::string& error);
+
+    // Constant-time lookup; nullptr if the token is unknown. The returned
+    // record stays valid for the lifetime of the store (while it is
+    // pinned by a TokenStoreRef).
+    const UserTokenInfo* find(const std::string& token) const;
+    const UserTokenInfo* find(const Digest& digest) const;
+
+    size_t size() const { return header_ ? header_->tokenCount : 0; }
+
+private:
+    bool attach(const uint8_t* data, size_t len, std::string& error);
+
+    void* map_ = nullptr;
+    size_t mapLen_ = 0;
+    std::vector<uint8_t> owned_;          // table built in memory
+    const TokenStoreHeader* header_ = nullptr;
+    const TokenRecord* records_ = nullptr;
+
+    // Records handed out by find(), one per slot, materialized on first
+    // use; racing threads settle it with a compare-exchange. calloc'd, so
+    // the pages of a large store stay untouched until used.
+    struct FreeDeleter { void operator()(void* p) const { std::free(p); } };
+    std::unique_ptr<std::atomic<const UserTokenInfo*>[], FreeDeleter> matched_;
+};
+
+// Serializes users into the store file format. False (error set) on a
+// duplicate digest or an invalid actor ID.
+bool buildTokenTable(const std::vector<UserTokenInfo>& users, std::vector<uint8_t>& out,
+                     std::string& error);
+
+// $GALLERYLOG_TOKENS, else TOKEN_STORE_PATH.
+std::string tokenStorePath();
+
+// A pinned generation of the token store: the store (and every record
+// find() returned from it) stays valid while the ref lives. Converts to
+// const TokenStore& for authenticateToken(); keep the ref in a variable
+// for as long as a returned UserTokenInfo* is used.
+class TokenStoreRef {
+public:
+    TokenStoreRef(TokenStoreRef&& other) noexcept : gen_(other.gen_) { other.gen_ = nullptr; }
+    TokenStoreRef(const TokenStoreRef&) = delete;
+    TokenStoreRef& operator=(const TokenStoreRef&) = delete;
+    TokenStoreRef& operator=(TokenStoreRef&&) = delete;
+    ~TokenStoreRef();
+
+    const TokenStore& operator*() const;
+    const TokenStore* operator->() const { return &**this; }
+    operator const TokenStore&() const { return **this; }
+
+    struct Generation; // token_store.cpp
+
+private:
+    friend TokenStoreRef getTokenStore();
+    explicit TokenStoreRef(Generation* gen) : gen_(gen) {}
+
+    Generation* gen_;
+};
+
+// The store every tool authenticates against: the store file if present
+// (an unusable file denies everyone rather than falling back), otherwise
+// the built-in store. Loaded on first use; lock-free afterwards.
+TokenStoreRef getTokenStore();
+
+// Loads the store again and publishes it for every later getTokenStore().
+// If the file is unusable (unsafe permissions, malformed) the current
+// store stays in place and false is returned with error set.
+bool reloadTokenStore(std::string& error);
+
+// inotify watch on the store file, for event loops: add fd() to the
+// loop, and when it is readable call changed(); true means the file was
+// replaced, written, removed or had its permissions changed since.
+class TokenStoreWatch {
+public:
+    TokenStoreWatch() = default;
+    ~TokenStoreWatch();
+    TokenStoreWatch(const TokenStoreWatch&) = delete;
+    TokenStoreWatch& operator=(const TokenStoreWatch&) = delete;
+
+    bool start(); // watches the directory of tokenStorePath()
+    int fd() const { return fd_; }
+    bool changed();
+
+private:
+    int fd_ = -1;
+    std::string name_; // store file name within the watched directory
+};
+
+const UserTokenInfo* authenticateToken(const std::string& providedToken,
+    Operation requiredOp, const TokenStore& store);
+
+#endif // TOKEN_STORE_H